@@ -0,0 +1,26 @@
+#!/bin/bash
+
+# Native micro-benchmarks for the physics engine (no Emscripten needed)
+# Usage: ./bench.sh [--max-n N] [--min-time SEC] [--filter TEXT] [--report FILE] ...
+
+BUILD_DIR="build"
+CXX="${CXX:-g++}"
+
+mkdir -p $BUILD_DIR
+
+echo "Compiling native benchmark..."
+
+$CXX bench/bench.cpp \
+    -o $BUILD_DIR/bench \
+    -O3 \
+    -march=native \
+    -fno-math-errno \
+    -pthread \
+    --std=c++17
+
+if [ $? -ne 0 ]; then
+    echo "Build failed!"
+    exit 1
+fi
+
+$BUILD_DIR/bench "$@"
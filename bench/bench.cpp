@@ -0,0 +1,379 @@
+/**
+ * Native micro-benchmarks for the physics engine in src/main.cpp
+ *
+ * Speed:    ns/step for every integrator and for calculateSystemProperties,
+ *           at N = 3 (figure-eight preset), 7 (solar system preset) and
+ *           10 / 100 / 1k / 10k (random Plummer spheres).
+ * Accuracy: relative energy and angular-momentum drift after a fixed amount
+ *           of simulated time, so a faster kernel cannot silently trade away
+ *           conservation.
+ * Allocs:   heap allocations per steady-state updateBodies() call, which must
+ *           be zero (the harness exits non-zero otherwise).
+ * Precision: mixed-precision (float32 pair terms) against the double force
+ *           kernel: throughput, acceleration error and energy drift.
+ *
+ * Build and run with ./bench.sh (see README.md for options).
+ */
+#define THREEBODY_NO_MAIN
+#include "../src/main.cpp"
+
+#include <chrono>
+#include <cstdarg>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+
+// Global allocation counter for the steady-state allocation check
+static size_t heapAllocations = 0;
+
+void* operator new(size_t size) {
+    heapAllocations++;
+    if (void* p = malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+namespace {
+
+// Harness options (overridable on the command line)
+size_t maxBodies = 10000;       // Skip scenarios larger than this
+double minSeconds = 0.25;       // Minimum measured time per benchmark
+double accuracyTime = 10.0;     // Simulated time for the drift report
+bool runSpeed = true;
+bool runAccuracy = true;
+const char* filter = nullptr;   // Substring filter on benchmark names
+FILE* reportFile = nullptr;     // Optional markdown copy of the accuracy table
+const char* tracePath = nullptr; // Optional Chrome trace of a short updateBodies() run
+
+struct Scenario {
+    const char* name;
+    size_t count;               // Body count (for sorting/filtering only)
+    double softening;
+    void (*load)(size_t count);
+};
+
+struct Integrator {
+    const char* name;
+    void (*step)();
+};
+
+const Integrator integrators[] = {
+    { "updateBodiesEuler",  updateBodiesEuler },
+    { "updateBodiesVerlet", updateBodiesVerlet },
+    { "updateBodiesRK4",    updateBodiesRK4 },
+    { "updateBodiesRKF45",  updateBodiesRKF45 },
+    { "updateBodiesHermite", updateBodiesHermite }
+};
+
+// Plummer sphere from the engine's generator: total mass 1000
+// (solar-system preset scale), scale radius 100, seeded by body count
+void loadPlummerSphere(size_t count) {
+    clearBodyStore();
+    generatePlummerSphere(count, 1000.0, 100.0, 0x3B0D1E5u + count);
+}
+
+void loadFigureEightScenario(size_t) { loadFigureEight(); }
+void loadLagrangeScenario(size_t) { loadLagrange(); }
+void loadSolarSystemScenario(size_t) { loadSolarSystem(); }
+
+const Scenario speedScenarios[] = {
+    { "figure-eight", 3,     0.0, loadFigureEightScenario },
+    { "solar-system", 7,     0.0, loadSolarSystemScenario },
+    { "plummer",      10,    1.0, loadPlummerSphere },
+    { "plummer",      100,   1.0, loadPlummerSphere },
+    { "plummer",      1000,  1.0, loadPlummerSphere },
+    { "plummer",      10000, 1.0, loadPlummerSphere }
+};
+
+const Scenario accuracyScenarios[] = {
+    { "figure-eight", 3,   0.0, loadFigureEightScenario },
+    { "lagrange",     3,   0.0, loadLagrangeScenario },
+    { "solar-system", 7,   0.0, loadSolarSystemScenario },
+    { "plummer",      100, 0.0, loadPlummerSphere }
+};
+
+// Put the engine into a known state: default physics, scenario bodies,
+// fresh conservation baselines
+void prepare(const Scenario& scenario) {
+    G = 1.0;
+    dt = 0.01;
+    timeScale = 1.0;
+    enableCollisions = false;
+    enableTidalForces = false;
+    enableGravitationalWaves = false;
+    softeningLength = scenario.softening;
+    mixedPrecision = false;
+    gameMode = GAME_MODE_DISABLED;
+    scenario.load(scenario.count);
+    saveInitialBodies();
+    selectKernels();
+    calculateSystemProperties();
+    saveInitialState();
+}
+
+bool selected(const std::string& name) {
+    return filter == nullptr || name.find(filter) != std::string::npos;
+}
+
+// Run fn until minSeconds have elapsed; returns ns per call
+double measure(void (*fn)(), long& iterations) {
+    using Clock = std::chrono::steady_clock;
+    iterations = 0;
+    long batch = 1;
+    double elapsed = 0.0;
+    while (elapsed < minSeconds) {
+        auto start = Clock::now();
+        for (long i = 0; i < batch; i++) {
+            fn();
+        }
+        elapsed += std::chrono::duration<double>(Clock::now() - start).count();
+        iterations += batch;
+        if (batch < (1L << 20)) batch *= 2;
+    }
+    return elapsed * 1e9 / iterations;
+}
+
+void runSpeedSuite() {
+    printf("%-44s %8s %14s %12s\n", "Benchmark", "N", "ns/step", "iterations");
+    printf("%s\n", std::string(81, '-').c_str());
+
+    for (const auto& scenario : speedScenarios) {
+        if (scenario.count > maxBodies) continue;
+
+        for (const auto& integrator : integrators) {
+            std::string name = std::string(integrator.name) + "/" + scenario.name;
+            if (!selected(name)) continue;
+            prepare(scenario);
+            long iterations = 0;
+            double ns = measure(integrator.step, iterations);
+            printf("%-44s %8zu %14.1f %12ld\n", name.c_str(), bodies.size(), ns, iterations);
+        }
+
+        std::string name = std::string("calculateSystemProperties/") + scenario.name;
+        if (selected(name)) {
+            prepare(scenario);
+            long iterations = 0;
+            double ns = measure(calculateSystemProperties, iterations);
+            printf("%-44s %8zu %14.1f %12ld\n", name.c_str(), bodies.size(), ns, iterations);
+        }
+    }
+    printf("\n");
+}
+
+void report(const char* format, ...) __attribute__((format(printf, 1, 2)));
+void report(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+    if (reportFile) {
+        va_start(args, format);
+        vfprintf(reportFile, format, args);
+        va_end(args);
+    }
+}
+
+void runAccuracySuite() {
+    long steps = static_cast<long>(accuracyTime / 0.01 + 0.5);
+    report("Accuracy after t = %.1f (dt = 0.01, %ld steps)\n\n", accuracyTime, steps);
+    report("| %-14s | %5s | %-20s | %14s | %14s |\n", "Scenario", "N", "Integrator", "|dE/E0|", "|dL/L0|");
+    report("|%s|%s|%s|%s|%s|\n", std::string(16, '-').c_str(), std::string(7, '-').c_str(),
+           std::string(22, '-').c_str(), std::string(16, '-').c_str(), std::string(16, '-').c_str());
+
+    for (const auto& scenario : accuracyScenarios) {
+        if (scenario.count > maxBodies) continue;
+        for (const auto& integrator : integrators) {
+            std::string name = std::string(integrator.name) + "/" + scenario.name;
+            if (!selected(name)) continue;
+            prepare(scenario);
+            for (long i = 0; i < steps; i++) {
+                integrator.step();
+            }
+            calculateSystemProperties();
+            report("| %-14s | %5zu | %-20s | %14.6e | %14.6e |\n", scenario.name, bodies.size(),
+                   integrator.name, energyDrift, angularMomentumDrift);
+        }
+    }
+    report("\n");
+}
+
+/**
+ * Mixed-precision force kernel against the double one on softened Plummer
+ * spheres: ns per force evaluation, acceleration error relative to the
+ * double result, and Verlet energy drift over the accuracy run (N <= 1000).
+ */
+void runPrecisionSuite() {
+    long steps = static_cast<long>(accuracyTime / 0.01 + 0.5);
+    report("Mixed precision vs double (calculateForces, Plummer, softening 1; drift: Verlet, %ld steps)\n\n", steps);
+    report("| %6s | %12s | %12s | %7s | %12s | %12s | %12s | %12s |\n", "N", "double ns", "mixed ns",
+           "speedup", "max |da|/|a|", "rms |da|/|a|", "|dE/E0| f64", "|dE/E0| mix");
+    report("|%s|%s|%s|%s|%s|%s|%s|%s|\n", std::string(8, '-').c_str(), std::string(14, '-').c_str(),
+           std::string(14, '-').c_str(), std::string(9, '-').c_str(), std::string(14, '-').c_str(),
+           std::string(14, '-').c_str(), std::string(14, '-').c_str(), std::string(14, '-').c_str());
+    
+    const Scenario* plummers[] = { &speedScenarios[3], &speedScenarios[4], &speedScenarios[5] };
+    for (const Scenario* scenario : plummers) {
+        if (scenario->count > maxBodies) continue;
+        long iterations = 0;
+        
+        prepare(*scenario);
+        double doubleNs = runSpeed ? measure(calculateForces, iterations) : 0.0;
+        calculateForces();
+        std::vector<Body> reference = bodies;
+        
+        mixedPrecision = true;
+        selectKernels();
+        double mixedNs = runSpeed ? measure(calculateForces, iterations) : 0.0;
+        calculateForces();
+        double maxError = 0.0, sumSq = 0.0;
+        for (size_t i = 0; i < bodies.size(); i++) {
+            const Body& r = reference[i];
+            double ex = bodies[i].ax - r.ax, ey = bodies[i].ay - r.ay, ez = bodies[i].az - r.az;
+            double error = sqrt(ex * ex + ey * ey + ez * ez) / sqrt(r.ax * r.ax + r.ay * r.ay + r.az * r.az);
+            maxError = std::max(maxError, error);
+            sumSq += error * error;
+        }
+        double rmsError = sqrt(sumSq / bodies.size());
+        
+        double drift[2] = { -1.0, -1.0 };
+        if (runAccuracy && scenario->count <= 1000) {
+            for (int mixed = 0; mixed < 2; mixed++) {
+                prepare(*scenario);
+                mixedPrecision = mixed != 0;
+                selectKernels();
+                for (long i = 0; i < steps; i++) {
+                    updateBodiesVerlet();
+                }
+                calculateSystemProperties();
+                drift[mixed] = energyDrift;
+            }
+        }
+        mixedPrecision = false;
+        
+        char speed[3][32] = { "-", "-", "-" };
+        if (runSpeed) {
+            snprintf(speed[0], sizeof(speed[0]), "%.1f", doubleNs);
+            snprintf(speed[1], sizeof(speed[1]), "%.1f", mixedNs);
+            snprintf(speed[2], sizeof(speed[2]), "%.2fx", doubleNs / mixedNs);
+        }
+        char drifts[2][32] = { "-", "-" };
+        for (int mixed = 0; mixed < 2; mixed++) {
+            if (drift[mixed] >= 0.0) snprintf(drifts[mixed], sizeof(drifts[mixed]), "%.6e", drift[mixed]);
+        }
+        report("| %6zu | %12s | %12s | %7s | %12.3e | %12.3e | %12s | %12s |\n", bodies.size(), speed[0],
+               speed[1], speed[2], maxError, rmsError, drifts[0], drifts[1]);
+    }
+    report("\n");
+}
+
+/**
+ * Run the full per-frame path (updateBodies) on a 100-body cluster and dump
+ * the phase timers as a Chrome trace, plus a summary from getPerfStats().
+ */
+void runTrace() {
+    const Scenario& scenario = speedScenarios[3];  // Plummer, N = 100
+    prepare(scenario);
+    currentMethod = METHOD_VERLET;
+    enableCollisions = true;
+    resetPerfStats();
+    setPerfTrace(true);
+    for (int i = 0; i < 200; i++) {
+        updateBodies();
+    }
+    if (writePerfTrace(tracePath)) {
+        printf("Wrote Chrome trace to %s\n", tracePath);
+    }
+    setPerfTrace(false);
+
+    const double* stats = getPerfStats();
+    const PerfStats& perf = *reinterpret_cast<const PerfStats*>(stats);
+    printf("Phase breakdown (updateBodies, Verlet, %s N = %zu, %.0f steps)\n", scenario.name, bodies.size(), perf.steps);
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        printf("  %-12s %10.3f ms total %10.0f calls\n", perfPhaseNames[i], perf.phaseTotalMs[i], perf.phaseCalls[i]);
+    }
+    printf("  pair interactions %.0f, collisions %.0f, merges %.0f, RKF45 rejections %.0f\n\n",
+           perf.pairInteractions, perf.collisions, perf.merges, perf.rkf45Rejections);
+}
+
+/**
+ * Every integrator, with collisions and merging enabled, must step without
+ * touching the heap once its scratch buffers have been sized.
+ */
+bool runAllocationCheck() {
+    const Scenario checks[] = { speedScenarios[0], speedScenarios[3] };
+    bool ok = true;
+    printf("Steady-state heap allocations per updateBodies() call\n");
+    for (const auto& scenario : checks) {
+        if (scenario.count > maxBodies) continue;
+        for (int method = METHOD_EULER; method <= METHOD_HERMITE; method++) {
+            prepare(scenario);
+            currentMethod = static_cast<IntegrationMethod>(method);
+            enableCollisions = true;
+            for (int i = 0; i < 10; i++) {
+                updateBodies();   // Warm-up sizes the scratch buffers
+            }
+            size_t before = heapAllocations;
+            const int steps = 100;
+            for (int i = 0; i < steps; i++) {
+                updateBodies();
+            }
+            size_t allocations = heapAllocations - before;
+            ok = ok && allocations == 0;
+            printf("  %-20s %-14s N = %-6zu %8.2f%s\n", integrators[method].name, scenario.name,
+                   bodies.size(), static_cast<double>(allocations) / steps, allocations ? "  FAIL" : "");
+        }
+    }
+    printf("\n");
+    return ok;
+}
+
+void usage(const char* program) {
+    printf("Usage: %s [options]\n", program);
+    printf("  --max-n N          skip scenarios with more than N bodies (default 10000)\n");
+    printf("  --min-time SEC     minimum measured time per benchmark (default 0.25)\n");
+    printf("  --accuracy-time T  simulated time for the drift report (default 10)\n");
+    printf("  --filter TEXT      only run benchmarks whose name contains TEXT\n");
+    printf("  --report FILE      also write the accuracy table to FILE\n");
+    printf("  --trace FILE       write a Chrome trace of the per-phase timers to FILE\n");
+    printf("  --speed-only | --accuracy-only\n");
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (!strcmp(arg, "--max-n") && hasValue) {
+            maxBodies = strtoul(argv[++i], nullptr, 10);
+        } else if (!strcmp(arg, "--min-time") && hasValue) {
+            minSeconds = atof(argv[++i]);
+        } else if (!strcmp(arg, "--accuracy-time") && hasValue) {
+            accuracyTime = atof(argv[++i]);
+        } else if (!strcmp(arg, "--filter") && hasValue) {
+            filter = argv[++i];
+        } else if (!strcmp(arg, "--report") && hasValue) {
+            reportFile = fopen(argv[++i], "w");
+        } else if (!strcmp(arg, "--trace") && hasValue) {
+            tracePath = argv[++i];
+        } else if (!strcmp(arg, "--speed-only")) {
+            runAccuracy = false;
+        } else if (!strcmp(arg, "--accuracy-only")) {
+            runSpeed = false;
+        } else {
+            usage(argv[0]);
+            return strcmp(arg, "--help") ? 1 : 0;
+        }
+    }
+
+    bool allocationFree = runAllocationCheck();
+    if (tracePath) runTrace();
+    if (runSpeed) runSpeedSuite();
+    if (runAccuracy) runAccuracySuite();
+    if (selected("precision")) runPrecisionSuite();
+
+    if (reportFile) fclose(reportFile);
+    return allocationFree ? 0 : 2;
+}
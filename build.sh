@@ -6,22 +6,33 @@ source /tmp/emsdk/emsdk_env.sh
 # Build directory
 BUILD_DIR="build"
 PUBLIC_DIR="public"
+GAME_DIR="nasa-mission-game/public"
 
 # Create build directory if it doesn't exist
 mkdir -p $BUILD_DIR
 mkdir -p $PUBLIC_DIR
 
+# THREADS=1 ./build.sh adds the worker pool for large scenes (WebAssembly
+# threads: the page must be cross-origin isolated, see serve.sh)
+THREAD_FLAGS=""
+if [ "$THREADS" = "1" ]; then
+    THREAD_FLAGS="-pthread -s PTHREAD_POOL_SIZE=navigator.hardwareConcurrency"
+fi
+
 # Compile C++ to WebAssembly
 echo "Compiling C++ to WebAssembly..."
 
 emcc src/main.cpp \
     -o $BUILD_DIR/main.js \
     -s WASM=1 \
-    -s EXPORTED_FUNCTIONS='["_init", "_update", "_reset", "_getBodyX", "_getBodyY", "_getBodyZ", "_getBodyRadius", "_getBodyColor", "_getBodyVX", "_getBodyVY", "_getBodyVZ", "_getBodyMass", "_getBodyCount", "_getTotalEnergy", "_getMomentumX", "_getMomentumY", "_getMomentumZ", "_getCenterOfMassX", "_getCenterOfMassY", "_getCenterOfMassZ", "_setGravitationalConstant", "_getGravitationalConstant", "_setTimeStep", "_getTimeStep", "_setTimeScale", "_getTimeScale", "_setIntegrator", "_getIntegrator", "_setCollisions", "_getCollisions", "_setCollisionDamping", "_loadPreset", "_addBody", "_removeBody", "_clearBodies", "_setBodyPosition", "_setBodyVelocity", "_setBodyMass", "_setBodyColor", "_findBodyAtPosition", "_getDistance", "_getKineticEnergy", "_saveState", "_setMergingEnabled", "_getMergingEnabled", "_setTidalForces", "_getTidalForces", "_setSofteningLength", "_getSofteningLength", "_setGravitationalWaves", "_getGravitationalWaves", "_getAngularMomentum", "_getAngularMomentumX", "_getAngularMomentumY", "_getAngularMomentumZ", "_getEnergyDrift", "_getMomentumDrift", "_getAngularMomentumDrift", "_startNASAMission", "_getGameMode", "_getMissionState", "_deploySpacecraft", "_getThreatDistance", "_getMissionTime", "_getTimeLimit", "_getClosestApproach", "_getDeltaVBudget", "_getDeltaVUsed", "_getMissionScore", "_getThreatRadius", "_getSafetyMargin", "_getEarthIndex", "_getAsteroidIndex", "_getSpacecraftIndex", "_saveInitialState", "_main"]' \
-    -s EXPORTED_RUNTIME_METHODS='["ccall", "cwrap"]' \
+    -s EXPORTED_FUNCTIONS='["_init", "_update", "_reset", "_getBodyX", "_getBodyY", "_getBodyZ", "_getBodyRadius", "_getBodyColor", "_getBodyVX", "_getBodyVY", "_getBodyVZ", "_getBodyMass", "_getBodyCount", "_getTotalEnergy", "_getMomentumX", "_getMomentumY", "_getMomentumZ", "_getCenterOfMassX", "_getCenterOfMassY", "_getCenterOfMassZ", "_setGravitationalConstant", "_getGravitationalConstant", "_setTimeStep", "_getTimeStep", "_setTimeScale", "_getTimeScale", "_setIntegrator", "_getIntegrator", "_setCollisions", "_getCollisions", "_setContinuousCollisions", "_getContinuousCollisions", "_setCollisionDamping", "_loadPreset", "_setBodies", "_getBodies", "_getBodyLayoutStride", "_getOrbitalElements", "_getTestParticleElements", "_getOrbitRecordStride", "_evaluatePotentialMap", "_getSystemRotationRate", "_setPotentialTheta", "_getPotentialTheta", "_findPeriodicOrbit", "_getPeriodicOrbitPeriod", "_getPeriodicOrbitResidual", "_setPeriodicTolerance", "_setVariationalSteps", "_getVariationalSteps", "_computeMonodromy", "_setBodiesSI", "_getBodiesSI", "_advanceSI", "_setSubstepAccuracy", "_getSubstepAccuracy", "_getUnitLength", "_getUnitMass", "_getUnitTime", "_getSimulationTimeSI", "_loadPlummerSphere", "_loadKeplerianDisk", "_addAsteroidBelt", "_addTestParticle", "_setTestParticles", "_addTestParticleBelt", "_clearTestParticles", "_getTestParticleCount", "_getTestParticleArray", "_addBody", "_removeBody", "_getBodyHandle", "_getBodyIndex", "_clearBodies", "_setBodyPosition", "_setBodyVelocity", "_setBodyMass", "_setBodyColor", "_findBodyAtPosition", "_findNearestBodies", "_findBodiesInRadius", "_setBodyOrdering", "_getBodyOrdering", "_setBodyOrderThreshold", "_getBodyOrderDisorder", "_reorderBodies", "_getBodyReorderCount", "_getDistance", "_getKineticEnergy", "_saveState", "_setMergingEnabled", "_getMergingEnabled", "_setTidalForces", "_getTidalForces", "_setSofteningLength", "_getSofteningLength", "_setGravitationalWaves", "_getGravitationalWaves", "_setPostNewtonian", "_getPostNewtonian", "_setDrag", "_getDrag", "_setKeplerFastForward", "_getKeplerFastForward", "_setKeplerTolerance", "_getKeplerTolerance", "_getKeplerPrimary", "_fastForward", "_predictClosestApproach", "_setMixedPrecision", "_getMixedPrecision", "_setWorkerThreads", "_getWorkerThreads", "_getTasksStolen", "_setParticleMesh", "_getParticleMesh", "_setMeshSize", "_getMeshSize", "_getAngularMomentum", "_getAngularMomentumX", "_getAngularMomentumY", "_getAngularMomentumZ", "_getEnergyDrift", "_getMomentumDrift", "_getAngularMomentumDrift", "_startNASAMission", "_getGameMode", "_getMissionState", "_deploySpacecraft", "_getThreatDistance", "_getMissionTime", "_getTimeLimit", "_getClosestApproach", "_getDeltaVBudget", "_getDeltaVUsed", "_getMissionScore", "_getThreatRadius", "_getSafetyMargin", "_getEarthIndex", "_getAsteroidIndex", "_getSpacecraftIndex", "_saveInitialState", "_setDriftSampleInterval", "_getDriftSampleInterval", "_getEnergyDriftMax", "_getEnergyDriftRMS", "_getEnergyDriftTimeOfMax", "_getMomentumDriftMax", "_getMomentumDriftRMS", "_getMomentumDriftTimeOfMax", "_getAngularMomentumDriftMax", "_getAngularMomentumDriftRMS", "_getAngularMomentumDriftTimeOfMax", "_getDriftSampleCount", "_getSimulationTime", "_getRenderState", "_getInterpolatedRenderState", "_advanceFrame", "_getInterpolationAlpha", "_setStepRate", "_getStepRate", "_setMaxStepsPerFrame", "_getDroppedSteps", "_resetFrameClock", "_addDistanceEvent", "_addApproachEvent", "_addPlaneEvent", "_removeEvent", "_clearEvents", "_getPendingEventCount", "_drainEvents", "_getEventRecordStride", "_getEventsDropped", "_addPoincareSection", "_addPhaseSampler", "_getSamplerBuffer", "_getSamplerCapacity", "_getSamplerCount", "_getSamplerHead", "_clearSamplerPoints", "_removeSampler", "_getRenderStateSize", "_getRenderHeaderSize", "_getRenderBodyStride", "_getRenderParticleStride", "_getPerfStats", "_getPerfStatsSize", "_resetPerfStats", "_malloc", "_free", "_main"]' \
+    -s EXPORTED_RUNTIME_METHODS='["ccall", "cwrap", "HEAPF64", "HEAP32"]' \
     -s ALLOW_MEMORY_GROWTH=1 \
     -s NO_EXIT_RUNTIME=1 \
     -O3 \
+    -msimd128 \
+    -fno-math-errno \
+    $THREAD_FLAGS \
     --std=c++17
 
 if [ $? -eq 0 ]; then
@@ -30,8 +41,10 @@ if [ $? -eq 0 ]; then
     # Copy output files to public directory
     cp $BUILD_DIR/main.js $PUBLIC_DIR/
     cp $BUILD_DIR/main.wasm $PUBLIC_DIR/
+    cp $BUILD_DIR/main.js $GAME_DIR/
+    cp $BUILD_DIR/main.wasm $GAME_DIR/
     
-    echo "Files copied to $PUBLIC_DIR/"
+    echo "Files copied to $PUBLIC_DIR/ and $GAME_DIR/"
     echo ""
     echo "To run the simulation:"
     echo "  1. Start a local web server:"
@@ -213,7 +213,7 @@ class ThreeBodyApp {
         // Update diagnostics
         const diag = this.physics.getDiagnostics(this.bodies);
         this.diagnostics.updateEnergy(diag.totalEnergy, this.time);
-        this.diagnostics.updatePhaseSpace(this.bodies);
+        this.diagnostics.updatePhaseSpace(this.bodies, dt * this.physics.timeDirection);
         
         return diag;
     }
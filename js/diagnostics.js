@@ -3,6 +3,40 @@
  * Handles energy graphs, phase space plots, and Poincaré sections
  */
 
+/**
+ * Fixed-capacity ring of (u, v) pairs in one Float64Array, so long phase
+ * histories and sections create no per-point garbage
+ */
+class PointRing {
+    constructor(capacity) {
+        this.capacity = capacity;
+        this.data = new Float64Array(capacity * 2);
+        this.head = 0;
+        this.length = 0;
+    }
+
+    push(u, v) {
+        this.data[2 * this.head] = u;
+        this.data[2 * this.head + 1] = v;
+        this.head = (this.head + 1) % this.capacity;
+        this.length = Math.min(this.length + 1, this.capacity);
+    }
+
+    // Visit pairs oldest first
+    forEach(fn) {
+        let index = (this.head - this.length + this.capacity) % this.capacity;
+        for (let i = 0; i < this.length; i++) {
+            fn(this.data[2 * index], this.data[2 * index + 1], i);
+            index = (index + 1) % this.capacity;
+        }
+    }
+
+    clear() {
+        this.head = 0;
+        this.length = 0;
+    }
+}
+
 class DiagnosticsPanel {
     constructor(energyCanvas, phaseCanvas) {
         this.energyCanvas = energyCanvas;
@@ -14,9 +48,10 @@ class DiagnosticsPanel {
         this.maxEnergyHistory = 500;
         this.initialEnergy = null;
         
-        this.phasePoints = [];
-        this.poincarePoints = [];
+        this.phasePoints = new PointRing(1000);         // (x, vx) per step
+        this.poincarePoints = new PointRing(20000);     // (x, vx) per crossing
         this.showPoincare = false;
+        this.lastPhaseSample = { x: 0, y: 0, vx: 0, vy: 0, valid: false };
         
         this.resize();
     }
@@ -47,25 +82,55 @@ class DiagnosticsPanel {
         }
     }
 
-    updatePhaseSpace(bodies) {
+    updatePhaseSpace(bodies, dt) {
         // Use first body for phase space (x vs vx)
         if (bodies.length > 0) {
             const body = bodies[0];
-            this.phasePoints.push({ x: body.x, vx: body.vx, y: body.y, vy: body.vy });
-            
-            if (this.phasePoints.length > 1000) {
-                this.phasePoints.shift();
+            this.phasePoints.push(body.x, body.vx);
+
+            // Poincaré section: y crossing zero upwards, located inside the
+            // step on the Hermite interpolant rather than sampled near y = 0
+            const prev = this.lastPhaseSample;
+            if (this.showPoincare && dt && prev.valid && prev.y < 0 && body.y >= 0) {
+                this.interpolateCrossing(prev, body, dt);
             }
-            
-            // Poincaré section: record points when y crosses zero with vy > 0
-            if (this.showPoincare && Math.abs(body.y) < 0.1 && body.vy > 0) {
-                this.poincarePoints.push({ x: body.x, vx: body.vx });
-                
-                if (this.poincarePoints.length > 500) {
-                    this.poincarePoints.shift();
-                }
+            prev.x = body.x;
+            prev.y = body.y;
+            prev.vx = body.vx;
+            prev.vy = body.vy;
+            prev.valid = true;
+        }
+    }
+
+    /**
+     * Cubic Hermite interpolation of one coordinate across a step of size h
+     * at fraction s: returns [position, velocity].
+     */
+    hermite(p0, v0, p1, v1, h, s) {
+        const s2 = s * s;
+        const s3 = s2 * s;
+        const p = (2 * s3 - 3 * s2 + 1) * p0 + (s3 - 2 * s2 + s) * h * v0 +
+                  (-2 * s3 + 3 * s2) * p1 + (s3 - s2) * h * v1;
+        const v = (6 * s2 - 6 * s) * (p0 - p1) / h + (3 * s2 - 4 * s + 1) * v0 + (3 * s2 - 2 * s) * v1;
+        return [p, v];
+    }
+
+    // Locate y = 0 between two samples (bisection on the interpolant) and
+    // record (x, vx) there
+    interpolateCrossing(prev, next, h) {
+        let lo = 0;
+        let hi = 1;
+        for (let i = 0; i < 40; i++) {
+            const mid = 0.5 * (lo + hi);
+            if (this.hermite(prev.y, prev.vy, next.y, next.vy, h, mid)[0] < 0) {
+                lo = mid;
+            } else {
+                hi = mid;
             }
         }
+        const s = 0.5 * (lo + hi);
+        const [x, vx] = this.hermite(prev.x, prev.vx, next.x, next.vx, h, s);
+        this.poincarePoints.push(x, vx);
     }
 
     drawEnergyGraph() {
@@ -164,12 +229,12 @@ class DiagnosticsPanel {
         let minX = Infinity, maxX = -Infinity;
         let minVx = Infinity, maxVx = -Infinity;
         
-        for (const point of this.phasePoints) {
-            minX = Math.min(minX, point.x);
-            maxX = Math.max(maxX, point.x);
-            minVx = Math.min(minVx, point.vx);
-            maxVx = Math.max(maxVx, point.vx);
-        }
+        this.phasePoints.forEach((x, vx) => {
+            minX = Math.min(minX, x);
+            maxX = Math.max(maxX, x);
+            minVx = Math.min(minVx, vx);
+            maxVx = Math.max(maxVx, vx);
+        });
         
         const rangeX = maxX - minX || 1;
         const rangeVx = maxVx - minVx || 1;
@@ -209,16 +274,16 @@ class DiagnosticsPanel {
             ctx.lineWidth = 1.5;
             ctx.beginPath();
             
-            for (let i = 0; i < this.phasePoints.length; i++) {
-                const x = ((this.phasePoints[i].x - minX) / (maxX - minX)) * width;
-                const y = height - ((this.phasePoints[i].vx - minVx) / (maxVx - minVx)) * height;
+            this.phasePoints.forEach((px, pvx, i) => {
+                const x = ((px - minX) / (maxX - minX)) * width;
+                const y = height - ((pvx - minVx) / (maxVx - minVx)) * height;
                 
                 if (i === 0) {
                     ctx.moveTo(x, y);
                 } else {
                     ctx.lineTo(x, y);
                 }
-            }
+            });
             
             ctx.stroke();
         }
@@ -227,14 +292,12 @@ class DiagnosticsPanel {
         if (this.showPoincare && this.poincarePoints.length > 0) {
             ctx.fillStyle = '#00ff88';
             
-            for (const point of this.poincarePoints) {
-                const x = ((point.x - minX) / (maxX - minX)) * width;
-                const y = height - ((point.vx - minVx) / (maxVx - minVx)) * height;
-                
-                ctx.beginPath();
-                ctx.arc(x, y, 2, 0, Math.PI * 2);
-                ctx.fill();
-            }
+            // Squares instead of arcs: sections hold tens of thousands of points
+            this.poincarePoints.forEach((px, pvx) => {
+                const x = ((px - minX) / (maxX - minX)) * width;
+                const y = height - ((pvx - minVx) / (maxVx - minVx)) * height;
+                ctx.fillRect(x - 1.5, y - 1.5, 3, 3);
+            });
         }
         
         // Draw labels
@@ -256,15 +319,16 @@ class DiagnosticsPanel {
 
     reset() {
         this.energyHistory = [];
-        this.phasePoints = [];
-        this.poincarePoints = [];
+        this.phasePoints.clear();
+        this.poincarePoints.clear();
+        this.lastPhaseSample.valid = false;
         this.initialEnergy = null;
     }
 
     togglePoincare() {
         this.showPoincare = !this.showPoincare;
         if (!this.showPoincare) {
-            this.poincarePoints = [];
+            this.poincarePoints.clear();
         }
     }
 }
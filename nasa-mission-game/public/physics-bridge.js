@@ -1,4 +1,16 @@
 // Physics Bridge - Interface to C++ WASM three-body physics engine
+//
+// The engine runs in SI scenario mode: bodies are uploaded in m, m/s and kg,
+// nondimensionalized inside the engine, and advanced with adaptive substeps
+// (see SI SCENARIO MODE in src/main.cpp). ./build.sh copies main.js/main.wasm
+// next to this file; without them the bridge falls back to JavaScript Euler.
+
+// Body record layout shared with the engine (BodyLayout::LAYOUT_PHASE_MASS)
+const LAYOUT_PHASE_MASS = 2;
+const RECORD_STRIDE = 7;      // x, y, z, vx, vy, vz, mass
+const INTEGRATOR_VERLET = 1;
+const BODY_ORDER = ['earth', 'moon', 'asteroid', 'spacecraft'];
+
 export class PhysicsBridge {
     constructor() {
         this.wasmModule = null;
@@ -10,13 +22,22 @@ export class PhysicsBridge {
         };
         this.moonProximityRecord = Infinity;
         this.G = 6.67430e-11;
+
+        // Engine units: Earth-Moon distance and Earth mass keep every
+        // quantity in the game within a few orders of magnitude of 1
+        this.lengthUnit = 384400000;
+        this.massUnit = 5.972e24;
+        this.maxSubsteps = 20000;   // Per update() call
+        this.engineOrder = [];      // Body names in engine index order
+        this.buffer = 0;            // Engine-side marshalling buffer
     }
 
     async init() {
-        // In production, this would load the compiled WASM module
-        // For now, we'll use JavaScript-based physics simulation
-        console.log('⚠️  Using JavaScript physics (WASM not compiled yet)');
-        console.log('   To use C++ WASM: compile src/main.cpp with Emscripten');
+        if (await this.loadWASM('main.js')) {
+            return;
+        }
+        console.log('⚠️  Using JavaScript physics (WASM engine not built)');
+        console.log('   To use C++ WASM: run ./build.sh in the repository root');
         
         // Fallback to JS implementation
         this.initJSPhysics();
@@ -35,15 +56,38 @@ export class PhysicsBridge {
             asteroid: { ...initialBodies.asteroid },
             spacecraft: { ...initialBodies.spacecraft }
         };
+        this.uploadBodies();
     }
 
     deploySpacecraft(spacecraft) {
         this.bodies.spacecraft = { ...spacecraft };
+        this.uploadBodies();
     }
 
     update(deltaTime) {
+        if (this.wasmModule) {
+            this.wasmModule._advanceSI(deltaTime, this.maxSubsteps);
+            this.downloadBodies();
+        } else {
+            this.updateJS(deltaTime);
+        }
+        
+        // Track Moon proximity for achievements
+        if (this.bodies.spacecraft.deployed) {
+            const distance = this.calculateDistance(
+                this.bodies.spacecraft.position,
+                this.bodies.moon.position
+            );
+            if (distance < this.moonProximityRecord) {
+                this.moonProximityRecord = distance;
+            }
+        }
+        
+        return this.bodies;
+    }
+
+    updateJS(deltaTime) {
         // Perform physics integration using simple Euler method
-        // In production, C++ WASM would use RK4 or Verlet integration
         
         const bodies = ['earth', 'moon', 'asteroid'];
         if (this.bodies.spacecraft.deployed) {
@@ -98,19 +142,6 @@ export class PhysicsBridge {
             body.position.y += body.velocity.y * deltaTime;
             body.position.z += body.velocity.z * deltaTime;
         });
-        
-        // Track Moon proximity for achievements
-        if (this.bodies.spacecraft.deployed) {
-            const distance = this.calculateDistance(
-                this.bodies.spacecraft.position,
-                this.bodies.moon.position
-            );
-            if (distance < this.moonProximityRecord) {
-                this.moonProximityRecord = distance;
-            }
-        }
-        
-        return this.bodies;
     }
 
     calculateGravitationalForce(body1, body2) {
@@ -161,6 +192,7 @@ export class PhysicsBridge {
         this.bodies.spacecraft.velocity.x *= factor;
         this.bodies.spacecraft.velocity.y *= factor;
         this.bodies.spacecraft.velocity.z *= factor;
+        this.uploadBodies();
     }
 
     usedMoonGravity() {
@@ -169,46 +201,43 @@ export class PhysicsBridge {
         return this.moonProximityRecord < moonSOI;
     }
 
-    // WASM-specific methods (for when C++ module is available)
-    async loadWASM(wasmPath) {
-        try {
-            const response = await fetch(wasmPath);
-            const bytes = await response.arrayBuffer();
-            
-            const wasmModule = await WebAssembly.instantiate(bytes, {
-                env: {
-                    // Import functions that C++ can call
-                    log: (message) => console.log('WASM:', message),
-                    abort: () => console.error('WASM aborted')
+    // Load the Emscripten build of src/main.cpp (classic script, global Module)
+    loadWASM(scriptPath) {
+        return new Promise((resolve) => {
+            window.Module = {
+                locateFile: (path) => path,
+                print: (text) => console.log('WASM:', text),
+                printErr: (text) => console.error('WASM:', text),
+                onRuntimeInitialized: () => {
+                    this.wasmModule = window.Module;
+                    this.wasmModule._setIntegrator(INTEGRATOR_VERLET);
+                    this.wasmModule._setCollisions(0);
+                    this.buffer = this.wasmModule._malloc(BODY_ORDER.length * RECORD_STRIDE * 8);
+                    console.log('✓ WASM Physics Module loaded');
+                    resolve(true);
                 }
-            });
-            
-            this.wasmModule = wasmModule.instance;
-            console.log('✓ WASM Physics Module loaded');
-            return true;
-        } catch (error) {
-            console.warn('Failed to load WASM module:', error);
-            return false;
-        }
+            };
+            const script = document.createElement('script');
+            script.src = scriptPath;
+            script.onerror = () => {
+                console.warn('Failed to load WASM module:', scriptPath);
+                resolve(false);
+            };
+            document.head.appendChild(script);
+        });
     }
 
-    // Call C++ functions (example)
-    callWASMUpdate(deltaTime) {
-        if (!this.wasmModule) return null;
+    // Replace the engine scene with the current JS state (SI units)
+    uploadBodies() {
+        if (!this.wasmModule) return;
         
-        // Example of calling exported C++ function
-        // const result = this.wasmModule.exports.updatePhysics(deltaTime);
-        // return result;
-    }
-
-    // Data marshalling for WASM
-    serializeBodies() {
-        // Convert JavaScript objects to format C++ expects
-        // Typically a Float64Array or structured buffer
-        const data = new Float64Array(48); // 4 bodies × 12 values each (pos, vel, mass)
+        this.engineOrder = BODY_ORDER.filter(name =>
+            this.bodies[name] && (name !== 'spacecraft' || this.bodies[name].deployed));
+        const data = this.wasmModule.HEAPF64.subarray(this.buffer >> 3,
+            (this.buffer >> 3) + this.engineOrder.length * RECORD_STRIDE);
         
         let offset = 0;
-        ['earth', 'moon', 'asteroid', 'spacecraft'].forEach(name => {
+        this.engineOrder.forEach(name => {
             const body = this.bodies[name];
             data[offset++] = body.position.x;
             data[offset++] = body.position.y;
@@ -217,23 +246,25 @@ export class PhysicsBridge {
             data[offset++] = body.velocity.y;
             data[offset++] = body.velocity.z;
             data[offset++] = body.mass;
-            offset += 5; // Padding
         });
         
-        return data;
+        this.wasmModule._setBodiesSI(this.buffer, this.engineOrder.length, LAYOUT_PHASE_MASS,
+                                     this.lengthUnit, this.massUnit);
     }
 
-    deserializeBodies(data) {
-        // Convert C++ output back to JavaScript objects
+    // Copy engine state back into the JS body objects (SI units)
+    downloadBodies() {
+        const count = this.wasmModule._getBodiesSI(this.buffer, LAYOUT_PHASE_MASS);
+        // HEAPF64 may have been replaced by memory growth; fetch it after the call
+        const data = this.wasmModule.HEAPF64.subarray(this.buffer >> 3,
+            (this.buffer >> 3) + count * RECORD_STRIDE);
+        
         let offset = 0;
-        ['earth', 'moon', 'asteroid', 'spacecraft'].forEach(name => {
-            this.bodies[name].position.x = data[offset++];
-            this.bodies[name].position.y = data[offset++];
-            this.bodies[name].position.z = data[offset++];
-            this.bodies[name].velocity.x = data[offset++];
-            this.bodies[name].velocity.y = data[offset++];
-            this.bodies[name].velocity.z = data[offset++];
-            offset += 6; // Skip mass and padding
+        this.engineOrder.slice(0, count).forEach(name => {
+            const body = this.bodies[name];
+            body.position = { x: data[offset], y: data[offset + 1], z: data[offset + 2] };
+            body.velocity = { x: data[offset + 3], y: data[offset + 4], z: data[offset + 5] };
+            offset += RECORD_STRIDE;
         });
     }
 
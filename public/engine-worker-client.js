@@ -0,0 +1,191 @@
+/**
+ * Engine Worker Client
+ * Main-thread side of physics-worker.js. Installs Module._xxx functions that
+ * forward commands to the worker and read getters straight out of the latest
+ * shared frame, so the page script works unchanged in either mode.
+ *
+ * Forwarded commands return a Promise of the engine's return value (the new
+ * handle from addBody, the index from findBodyAtPosition...); callers that
+ * need a result `await` it, which also works on the plain numbers the
+ * in-thread engine returns.
+ *
+ * Requires cross-origin isolation (SharedArrayBuffer); see serve.sh.
+ */
+
+class EngineWorkerClient {
+    static isSupported() {
+        return typeof SharedArrayBuffer !== 'undefined' &&
+               typeof Atomics !== 'undefined' &&
+               window.crossOriginIsolated === true &&
+               new URLSearchParams(window.location.search).get('worker') !== '0';
+    }
+
+    constructor(module) {
+        this.module = module;
+        this.control = new Int32Array(new SharedArrayBuffer(2 * Int32Array.BYTES_PER_ELEMENT));
+        this.frames = null;         // Allocated by the worker, sized to the scene
+        this.frame = null;          // Latched frame (a view, never copied)
+        this.headerSize = 0;
+        this.bodyStride = 0;
+        this.particleStride = 0;
+        this.nextCallId = 0;
+        this.pendingCalls = new Map();   // Call id -> resolve
+
+        Atomics.store(this.control, 1, -1);
+
+        this.worker = new Worker('physics-worker.js');
+        this.worker.onmessage = (event) => {
+            const message = event.data;
+            switch (message.type) {
+                case 'ready':
+                    this.start(message.headerSize, message.bodyStride, message.particleStride);
+                    break;
+                case 'frames':
+                    this.useFrames(message.frames);
+                    break;
+                case 'result':
+                    this.pendingCalls.get(message.id)(message.value);
+                    this.pendingCalls.delete(message.id);
+                    break;
+            }
+        };
+    }
+
+    start(headerSize, bodyStride, particleStride) {
+        this.headerSize = headerSize;
+        this.bodyStride = bodyStride;
+        this.particleStride = particleStride;
+        this.worker.postMessage({ type: 'init', control: this.control.buffer });
+    }
+
+    // New (larger) frame pair from the worker; the first one starts the page
+    useFrames(buffers) {
+        const first = this.frames === null;
+        this.frames = buffers.map((buffer) => new Float64Array(buffer));
+        this.latch();
+        if (first) {
+            this.installModuleFunctions();
+            if (this.module.onRuntimeInitialized) {
+                this.module.onRuntimeInitialized();
+            }
+        }
+    }
+
+    /**
+     * Pick up the most recently published frame. The buffer index is announced
+     * before re-checking the sequence number; if a publish raced in between,
+     * retry so the writer can never be filling the frame we hold.
+     */
+    latch() {
+        for (;;) {
+            const seq = Atomics.load(this.control, 0);
+            Atomics.store(this.control, 1, seq & 1);
+            if (Atomics.load(this.control, 0) === seq) {
+                this.frame = this.frames[seq & 1];
+                return seq;
+            }
+        }
+    }
+
+    // Post a message the worker answers with a 'result'
+    request(message) {
+        const id = this.nextCallId++;
+        this.worker.postMessage({ ...message, id });
+        return new Promise((resolve) => this.pendingCalls.set(id, resolve));
+    }
+
+    call(name, ...args) {
+        return this.request({ type: 'call', name, args });
+    }
+
+    // Module._<name>(index, ...args) on the body behind handle; resolves to
+    // its index, or -1 (nothing applied) once the body is gone
+    callOnBody(name, handle, ...args) {
+        return this.request({ type: 'callOnBody', name, handle, args });
+    }
+
+    // Body under (x, y) as { index, handle }; index -1 when there is none
+    pickBody(x, y) {
+        return this.request({ type: 'pickBody', x, y });
+    }
+
+    setRunning(running) {
+        this.worker.postMessage({ type: 'running', running });
+    }
+
+    setStepRate(stepsPerSecond) {
+        this.worker.postMessage({ type: 'stepRate', stepRate: stepsPerSecond });
+    }
+
+    // Header field indices mirror RenderHeaderField in src/main.cpp
+    header(field) {
+        return this.frame[field];
+    }
+
+    bodyCount() {
+        return this.frame[0];
+    }
+
+    body(index, field) {
+        if (index < 0 || index >= this.bodyCount()) return 0.0;
+        return this.frame[this.headerSize + index * this.bodyStride + field];
+    }
+
+    simulationTime() {
+        return this.frame[1];
+    }
+
+    installModuleFunctions() {
+        const m = this.module;
+        const commands = [
+            'init', 'reset', 'loadPreset', 'addBody', 'removeBody', 'clearBodies', 'saveState',
+            'setGravitationalConstant', 'setTimeStep', 'setTimeScale', 'setIntegrator',
+            'setCollisions', 'setContinuousCollisions', 'setCollisionDamping', 'setMergingEnabled', 'setTidalForces',
+            'setSofteningLength', 'setGravitationalWaves', 'setPostNewtonian', 'setDrag', 'setKeplerFastForward',
+            'setKeplerTolerance', 'fastForward', 'setMixedPrecision',
+            'setParticleMesh', 'setMeshSize', 'setBodyPosition', 'setBodyVelocity',
+            'setBodyMass', 'setBodyColor', 'startNASAMission', 'deploySpacecraft',
+            'loadPlummerSphere', 'loadKeplerianDisk', 'addAsteroidBelt',
+            'addTestParticle', 'addTestParticleBelt', 'clearTestParticles',
+            // Answered by the worker's engine (k-d tree picking, handles)
+            'findBodyAtPosition', 'getBodyHandle', 'getBodyIndex'
+        ];
+        for (const name of commands) {
+            m['_' + name] = (...args) => this.call(name, ...args);
+        }
+
+        // Stepping happens in the worker
+        m._update = () => {};
+
+        m._getBodyCount = () => this.bodyCount();
+        m._getBodyX = (i) => this.body(i, 0);
+        m._getBodyY = (i) => this.body(i, 1);
+        m._getBodyZ = (i) => this.body(i, 2);
+        m._getBodyVX = (i) => this.body(i, 3);
+        m._getBodyVY = (i) => this.body(i, 4);
+        m._getBodyVZ = (i) => this.body(i, 5);
+        m._getBodyMass = (i) => this.body(i, 6);
+        m._getBodyRadius = (i) => this.body(i, 7);
+        m._getBodyColor = (i) => (i >= 0 && i < this.bodyCount()) ? this.body(i, 8) >>> 0 : 0xFFFFFFFF;
+        m._getKineticEnergy = (i) => {
+            const vx = this.body(i, 3), vy = this.body(i, 4), vz = this.body(i, 5);
+            return 0.5 * this.body(i, 6) * (vx * vx + vy * vy + vz * vz);
+        };
+
+        m._getSimulationTime = () => this.header(1);
+        m._getTimeStep = () => this.header(2);
+        m._getTotalEnergy = () => this.header(3);
+        m._getMomentumX = () => this.header(4);
+        m._getMomentumY = () => this.header(5);
+        m._getMomentumZ = () => this.header(6);
+        m._getAngularMomentum = () => this.header(7);
+        m._getEnergyDrift = () => this.header(8);
+        m._getMomentumDrift = () => this.header(9);
+        m._getAngularMomentumDrift = () => this.header(10);
+        m._getCenterOfMassX = () => this.header(11);
+        m._getCenterOfMassY = () => this.header(12);
+        m._getCenterOfMassZ = () => this.header(13);
+        m._getGameMode = () => this.header(14);
+        m._getMissionState = () => this.header(15);
+    }
+}
@@ -0,0 +1,158 @@
+/**
+ * Physics Worker
+ * Runs the WASM engine's stepping loop off the main thread (fixed dt steps
+ * via advanceFrame) and publishes the interpolated state after every tick
+ * into a double-buffered SharedArrayBuffer.
+ *
+ * Shared layout:
+ *   Int32Array control[CONTROL_SIZE]   sequence number + reader handshake
+ *                                      (created by engine-worker-client.js)
+ *   Float64Array frames[2]             header + per-body and test-particle
+ *                                      records, see RenderHeaderField in
+ *                                      src/main.cpp (created here, sized
+ *                                      to the scene)
+ *
+ * Publishing protocol (lock-free):
+ *   - The published frame is frames[seq & 1].
+ *   - The writer fills the other buffer and then bumps seq (Atomics.store).
+ *   - The reader announces the buffer it is reading in control[READER];
+ *     the writer never fills that buffer, it simply skips publishing until
+ *     the reader moves on. Stepping itself never waits for the reader.
+ *   - When a frame outgrows the buffers (more bodies or test particles),
+ *     the writer allocates a larger pair, publishes into it and posts it to
+ *     the reader ('frames'). Frames are never truncated; the reader keeps
+ *     drawing its old pair until the new one arrives.
+ *
+ * Commands arrive as 'call' messages; the engine's return value goes back
+ * as a 'result' message with the caller's id. 'callOnBody' and 'pickBody'
+ * address bodies by handle, resolving it in the same message so a body
+ * removed or merged in between steps is never mistaken for another.
+ */
+
+const CONTROL_SEQUENCE = 0;
+const CONTROL_READER = 1;
+
+let control = null;
+let frames = null;
+let frameCapacity = 0;      // Doubles per frame buffer
+let headerSize = 0;
+let bodyStride = 0;
+let particleStride = 0;
+
+// Calls that only read the engine; no new frame is published after them
+const QUERIES = new Set(['findBodyAtPosition', 'getBodyHandle', 'getBodyIndex']);
+
+let running = true;
+let lastTick = 0;
+let lastDiagnostics = 0;
+const maxStepsPerTick = 1000;
+const diagnosticsInterval = 100;   // ms between energy/momentum refreshes
+
+var Module = {
+    locateFile: (path) => path,
+    print: (text) => console.log(text),
+    printErr: (text) => console.error(text),
+    onRuntimeInitialized: function() {
+        headerSize = Module._getRenderHeaderSize();
+        bodyStride = Module._getRenderBodyStride();
+        particleStride = Module._getRenderParticleStride();
+        Module._setMaxStepsPerFrame(maxStepsPerTick);
+        postMessage({ type: 'ready', headerSize, bodyStride, particleStride });
+    }
+};
+importScripts('main.js');
+
+// New shared frame pair with room for size doubles (plus headroom so a
+// growing scene does not reallocate on every added body)
+function allocateFrames(size) {
+    frameCapacity = Math.ceil(size * 1.5);
+    const bytes = frameCapacity * Float64Array.BYTES_PER_ELEMENT;
+    frames = [new Float64Array(new SharedArrayBuffer(bytes)), new Float64Array(new SharedArrayBuffer(bytes))];
+}
+
+function publish(withDiagnostics) {
+    const ptr = Module._getInterpolatedRenderState(withDiagnostics ? 1 : 0) >> 3;
+    const size = Module._getRenderStateSize();
+    const grown = frames === null || size > frameCapacity;
+    if (grown) {
+        allocateFrames(size);
+    }
+
+    const seq = Atomics.load(control, CONTROL_SEQUENCE);
+    const target = (seq + 1) & 1;
+    if (!grown && Atomics.load(control, CONTROL_READER) === target) {
+        return false;   // Reader still holds the older frame
+    }
+    frames[target].set(Module.HEAPF64.subarray(ptr, ptr + size));
+    Atomics.store(control, CONTROL_SEQUENCE, seq + 1);
+
+    if (grown) {
+        postMessage({ type: 'frames', frames: frames.map((frame) => frame.buffer) });
+    }
+    return true;
+}
+
+function tick() {
+    const now = performance.now();
+    const withDiagnostics = now - lastDiagnostics >= diagnosticsInterval;
+
+    if (running) {
+        // Fixed dt steps for the elapsed time; the engine drops the backlog
+        // past maxStepsPerTick instead of spiralling
+        Module._advanceFrame((now - lastTick) / 1000);
+    }
+    if (publish(withDiagnostics) && withDiagnostics) {
+        lastDiagnostics = now;
+    }
+
+    lastTick = now;
+    setTimeout(tick, 0);
+}
+
+onmessage = (event) => {
+    const message = event.data;
+    switch (message.type) {
+        case 'init':
+            control = new Int32Array(message.control);
+            lastTick = performance.now();
+            publish(true);
+            tick();
+            break;
+        case 'call': {
+            // Engine call forwarded from the main thread (setters, presets,
+            // picking...); the return value resolves the caller's promise
+            const value = Module['_' + message.name](...message.args);
+            postMessage({ type: 'result', id: message.id, value });
+            if (!QUERIES.has(message.name)) {
+                publish(true);
+            }
+            break;
+        }
+        case 'callOnBody': {
+            // Module._<name>(index, ...args) on the body behind a handle;
+            // replies with the index, or -1 (nothing applied) once it is gone
+            const index = Module._getBodyIndex(message.handle);
+            if (index >= 0) {
+                Module['_' + message.name](index, ...message.args);
+            }
+            postMessage({ type: 'result', id: message.id, value: index });
+            if (index >= 0) {
+                publish(true);
+            }
+            break;
+        }
+        case 'pickBody': {
+            const index = Module._findBodyAtPosition(message.x, message.y);
+            const handle = index >= 0 ? Module._getBodyHandle(index) : 0;
+            postMessage({ type: 'result', id: message.id, value: { index, handle } });
+            break;
+        }
+        case 'running':
+            running = message.running;
+            Module._resetFrameClock();
+            break;
+        case 'stepRate':
+            Module._setStepRate(message.stepRate);
+            break;
+    }
+};
@@ -1,7 +1,19 @@
 #!/bin/bash
 
 # Start web server in public directory
+# Sends cross-origin isolation headers so SharedArrayBuffer is available
+# and the engine can run in a Web Worker (physics-worker.js)
 cd public
 echo "Starting web server on http://localhost:8080"
 echo "Press Ctrl+C to stop"
-python3 -m http.server 8080
+python3 - <<'PYTHON'
+import http.server
+
+class IsolatedHandler(http.server.SimpleHTTPRequestHandler):
+    def end_headers(self):
+        self.send_header('Cross-Origin-Opener-Policy', 'same-origin')
+        self.send_header('Cross-Origin-Embedder-Policy', 'credentialless')
+        super().end_headers()
+
+http.server.ThreadingHTTPServer(('', 8080), IsolatedHandler).serve_forever()
+PYTHON
@@ -1,9 +1,34 @@
+#ifdef __EMSCRIPTEN__
 #include <emscripten/emscripten.h>
 #include <emscripten/html5.h>
+#else
+// Native builds (bench/) compile the engine without Emscripten
+#define EMSCRIPTEN_KEEPALIVE
+#endif
 #include <cmath>
 #include <cstdio>
 #include <vector>
 #include <algorithm>
+#include <array>
+#include <utility>
+#include <chrono>
+#include <random>
+#include <complex>
+#include <cstdint>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// Worker threads for the large-N phases (see TASK SCHEDULER): on natively
+// and in Emscripten builds with -pthread, off in the plain WebAssembly build
+#ifndef THREEBODY_THREADS
+#if defined(__EMSCRIPTEN__) && !defined(__EMSCRIPTEN_PTHREADS__)
+#define THREEBODY_THREADS 0
+#else
+#define THREEBODY_THREADS 1
+#endif
+#endif
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
@@ -39,7 +64,252 @@ struct Body {
 
 // Simulation state
 std::vector<Body> bodies;
-std::vector<Body> initialBodies; // Store initial state for reset
+std::vector<Body> initialBodies; // Store initial state for reset (external order)
+
+// External body index <-> slot in bodies. The store is re-sorted along a
+// space-filling curve for locality (see BODY ORDER), while the indices
+// JS, events and render records use keep naming the same body. Empty maps
+// mean identity, and bodies appended since the last sort sit at matching
+// indices past the end of the maps.
+std::vector<uint32_t> bodySlots;   // External index -> slot
+std::vector<uint32_t> bodyRanks;   // Slot -> external index
+
+inline size_t bodySlot(size_t index) {
+    return index < bodySlots.size() ? bodySlots[index] : index;
+}
+
+inline int bodyRank(int slot) {
+    return slot >= 0 && static_cast<size_t>(slot) < bodyRanks.size() ? static_cast<int>(bodyRanks[slot]) : slot;
+}
+
+// Same for stored body references, where negative means none
+inline int bodyReferenceSlot(int index) {
+    return index < 0 ? index : static_cast<int>(bodySlot(index));
+}
+
+inline const Body& bodyAt(size_t index) {
+    return bodies[bodySlot(index)];
+}
+
+/**
+ * BODY HANDLES: generational slot map over the body store
+ * 
+ * External indices are dense and change when bodies are removed or merged
+ * (the last body takes over the freed index). A handle names one body for
+ * its whole lifetime: the low 32 bits pick an entry of bodyHandleEntries,
+ * which holds the body's current slot, and the bits above carry the
+ * entry's generation. Removing the body releases the entry and bumps its
+ * generation, so old copies of the handle stop resolving instead of
+ * silently naming whichever body moved in. Handles
+ * stay below 2^53 and pass through JavaScript numbers exactly; 0 is never
+ * a live handle. Bodies appended since the last registration get their
+ * entries lazily (extendBodyHandles), like the order maps above.
+ */
+typedef uint64_t BodyHandle;
+const BodyHandle NO_BODY = 0;
+const int BODY_HANDLE_GENERATION_BITS = 21;
+const uint32_t BODY_HANDLE_FREE = UINT32_MAX;
+
+struct BodyHandleEntry {
+    uint32_t slot;         // Slot in bodies, BODY_HANDLE_FREE once released
+    uint32_t generation;   // 1..2^21-1, bumped on every release
+    uint32_t initial;      // Index in initialBodies (see initialBodyIndex)
+};
+
+std::vector<BodyHandleEntry> bodyHandleEntries;
+std::vector<uint32_t> freeBodyHandles;   // Released entries, reused last-in first-out
+std::vector<uint32_t> slotHandles;       // Slot -> entry, for the registered prefix
+
+// Give every body appended since the last call an entry
+void extendBodyHandles() {
+    while (slotHandles.size() < bodies.size()) {
+        uint32_t entry;
+        if (!freeBodyHandles.empty()) {
+            entry = freeBodyHandles.back();
+            freeBodyHandles.pop_back();
+        } else {
+            entry = static_cast<uint32_t>(bodyHandleEntries.size());
+            bodyHandleEntries.push_back({ BODY_HANDLE_FREE, 1, BODY_HANDLE_FREE });
+        }
+        bodyHandleEntries[entry].slot = static_cast<uint32_t>(slotHandles.size());
+        slotHandles.push_back(entry);
+    }
+}
+
+void releaseBodyHandle(uint32_t entry) {
+    BodyHandleEntry& e = bodyHandleEntries[entry];
+    e.slot = BODY_HANDLE_FREE;
+    e.generation = (e.generation + 1) & ((1u << BODY_HANDLE_GENERATION_BITS) - 1);
+    if (e.generation == 0) e.generation = 1;
+    freeBodyHandles.push_back(entry);
+}
+
+BodyHandle bodyHandle(size_t slot) {
+    extendBodyHandles();
+    const uint32_t entry = slotHandles[slot];
+    return static_cast<BodyHandle>(entry) | static_cast<BodyHandle>(bodyHandleEntries[entry].generation) << 32;
+}
+
+inline BodyHandleEntry& bodyHandleEntry(BodyHandle handle) {
+    return bodyHandleEntries[handle & 0xFFFFFFFFu];
+}
+
+// Slot of a live handle, -1 once its body is gone
+int bodyHandleSlot(BodyHandle handle) {
+    const uint64_t entry = handle & 0xFFFFFFFFu;
+    if (entry >= bodyHandleEntries.size()) return -1;
+    const BodyHandleEntry& e = bodyHandleEntries[entry];
+    if (e.slot == BODY_HANDLE_FREE || e.generation != (handle >> 32)) return -1;
+    return static_cast<int>(e.slot);
+}
+
+// Cover bodies appended since the last sort
+void extendBodyOrder() {
+    while (bodySlots.size() < bodies.size()) {
+        bodySlots.push_back(static_cast<uint32_t>(bodySlots.size()));
+        bodyRanks.push_back(static_cast<uint32_t>(bodyRanks.size()));
+    }
+}
+
+// External order = current slot order
+void resetBodyOrder() {
+    bodySlots.clear();
+    bodyRanks.clear();
+}
+
+// Replace the whole scene: external order restarts as insertion order,
+// and every handle into the old scene stops resolving
+void clearBodyStore() {
+    for (uint32_t entry : slotHandles) {
+        releaseBodyHandle(entry);
+    }
+    slotHandles.clear();
+    bodies.clear();
+    resetBodyOrder();
+}
+
+void retargetBodyReferences(size_t removed, size_t moved);   // See BODY ORDER
+
+// Remove the body in slot in O(1): the body in the last slot moves into
+// the hole, and the body with the last external index takes over the
+// removed one's index. References to the moved body follow it.
+void eraseBody(size_t slot) {
+    const size_t last = bodies.size() - 1;
+    if (!bodySlots.empty()) {
+        extendBodyOrder();
+        const uint32_t rank = bodyRanks[slot];
+        const uint32_t heir = bodySlots[last];   // Slot holding the last external index
+        bodySlots[rank] = heir;
+        bodyRanks[heir] = rank;
+        if (slot != last) {
+            bodySlots[bodyRanks[last]] = static_cast<uint32_t>(slot);
+            bodyRanks[slot] = bodyRanks[last];
+        }
+        bodySlots.pop_back();
+        bodyRanks.pop_back();
+    }
+    
+    extendBodyHandles();
+    releaseBodyHandle(slotHandles[slot]);
+    if (slot != last) {
+        slotHandles[slot] = slotHandles[last];
+        bodyHandleEntries[slotHandles[slot]].slot = static_cast<uint32_t>(slot);
+        bodies[slot] = bodies[last];
+    }
+    slotHandles.pop_back();
+    bodies.pop_back();
+    retargetBodyReferences(slot, last);
+}
+
+// Handles of initialBodies, so engine-held handles survive reset()
+std::vector<BodyHandle> initialBodyHandles;
+
+void saveInitialBodies() {
+    initialBodies.resize(bodies.size());
+    initialBodyHandles.resize(bodies.size());
+    for (size_t i = 0; i < bodies.size(); i++) {
+        initialBodies[i] = bodyAt(i);
+        initialBodyHandles[i] = bodyHandle(bodySlot(i));
+        bodyHandleEntry(initialBodyHandles[i]).initial = static_cast<uint32_t>(i);
+    }
+}
+
+// Position of a body in initialBodies, -1 if it is not part of the snapshot.
+// The entry's index is only trusted when the snapshot holds the same handle.
+int initialBodyIndex(BodyHandle handle) {
+    if (handle == NO_BODY || (handle & 0xFFFFFFFFu) >= bodyHandleEntries.size()) return -1;
+    const uint32_t k = bodyHandleEntry(handle).initial;
+    return k < initialBodyHandles.size() && initialBodyHandles[k] == handle ? static_cast<int>(k) : -1;
+}
+
+// Single-body snapshot edits for addBody/removeBody, O(1) instead of a
+// full saveInitialBodies()
+void appendInitialBody(size_t slot) {
+    const BodyHandle handle = bodyHandle(slot);
+    bodyHandleEntry(handle).initial = static_cast<uint32_t>(initialBodies.size());
+    initialBodies.push_back(bodies[slot]);
+    initialBodyHandles.push_back(handle);
+}
+
+void eraseInitialBody(BodyHandle handle) {
+    const int k = initialBodyIndex(handle);
+    if (k < 0) return;
+    const size_t last = initialBodies.size() - 1;
+    if (static_cast<size_t>(k) != last) {
+        initialBodies[k] = initialBodies[last];
+        initialBodyHandles[k] = initialBodyHandles[last];
+        BodyHandleEntry& moved = bodyHandleEntry(initialBodyHandles[k]);
+        if (moved.initial == last) moved.initial = static_cast<uint32_t>(k);
+    }
+    initialBodies.pop_back();
+    initialBodyHandles.pop_back();
+}
+
+// Acceleration and jerk (da/dt) of one body, for the Hermite integrator
+struct HermiteDerivatives {
+    double ax, ay, az;
+    double jx, jy, jz;
+};
+
+// Candidate pair for the near-pair force terms (see FORCE TERMS)
+struct ForcePair {
+    uint32_t i, j;
+    double dist;
+};
+
+// Bodies per block in the mixed-precision force kernel (one float tile)
+const size_t PRECISION_BLOCK_SIZE = 64;
+
+// Preallocated per-step scratch buffers. Grown by selectKernels() whenever the
+// body count changes, so the steady-state step loop never touches the heap.
+struct StepScratch {
+    std::vector<Body> stageBodies;   // RK4/RKF45 trial state, Hermite/Kepler next state
+    std::vector<Body> nextBodies;    // RKF45 end-of-step state
+    std::vector<size_t> removals;    // Bodies merged away in handleCollisions
+    std::vector<char> removed;       // Per slot: already merged away this step
+    std::vector<float> localBodies;  // Mixed precision: x, y, z, G*m (SoA)
+    std::vector<double> blockOrigins; // Mixed precision: block centroids
+    std::vector<HermiteDerivatives> hermiteStart; // Hermite: a, j at step start
+    std::vector<HermiteDerivatives> hermiteEnd;   // Hermite: a, j at predicted state
+    std::vector<Body> hermiteBodies;  // Hermite: state hermiteStart belongs to
+    std::vector<ForcePair> forcePairs; // Near-pair force terms: candidate pairs
+    std::vector<double> rowSums;      // Diagnostics: potential energy per row
+    
+    void reserve(size_t count) {
+        stageBodies.reserve(count);
+        nextBodies.reserve(count);
+        removals.reserve(count);
+        removed.reserve(count);
+        localBodies.reserve(4 * count);
+        blockOrigins.reserve(3 * (count / PRECISION_BLOCK_SIZE + 1));
+        hermiteStart.reserve(count);
+        hermiteEnd.reserve(count);
+        hermiteBodies.reserve(count);
+        forcePairs.reserve(count);
+        rowSums.reserve(count);
+    }
+};
+StepScratch stepScratch;
 
 // Physics parameters
 double G = 1.0;         // Gravitational constant (scaled for simulation)
@@ -51,29 +321,76 @@ enum IntegrationMethod {
     METHOD_EULER,        // Basic Euler method (PDF Section 3.2)
     METHOD_VERLET,       // Velocity Verlet (symplectic)
     METHOD_RK4,          // Runge-Kutta 4th order
-    METHOD_RKF45         // Runge-Kutta-Fehlberg adaptive (PDF Section 3.3)
+    METHOD_RKF45,        // Runge-Kutta-Fehlberg adaptive (PDF Section 3.3)
+    METHOD_HERMITE       // 4th-order Hermite predictor-corrector (a + jerk)
 };
 IntegrationMethod currentMethod = METHOD_VERLET;
 
 bool enableCollisions = false;
+bool continuousCollisions = false; // Swept-sphere time-of-impact (see handleCollisions)
 double collisionDamping = 0.8; // Coefficient of restitution
 bool enableMerging = true;     // Allow bodies to merge on collision
 bool enableTidalForces = false; // Tidal deformation effects
 double softeningLength = 0.0;   // Gravitational softening (OFF by default for pure Newton)
 bool conserveAngularMomentum = true; // Enforce angular momentum conservation
 bool enableGravitationalWaves = false; // Energy loss from GW radiation
+bool mixedPrecision = false;    // float32 pair terms for large-N runs (see calculateForcesMixedKernel)
+bool enablePostNewtonian = false; // 1PN correction (see FORCE TERMS)
+double dragCoefficient = 0.0;   // Linear drag a -= k v (0 = off)
+double speedOfLight = 300.0;    // c in scaled units (GW and 1PN terms)
 
 // RKF45 adaptive parameters
 double rkfTolerance = 1e-6;     // Error tolerance for adaptive stepping
 double minDt = 0.001;           // Minimum time step
 double maxDt = 0.1;             // Maximum time step
 
+// Hermite step control (Aarseth criterion, see updateBodiesHermite)
+double hermiteEta = 0.02;       // Accuracy parameter for the running criterion
+double hermiteStartEta = 0.01;  // Startup criterion |a| / |j| before snap is known
+int hermiteMaxSubsteps = 64;    // Substep cap per dt * timeScale
+double hermiteStepSize = 0.0;   // Criterion from the last step (0 = restart)
+double hermiteG = 0.0;          // G and softening hermiteStart was evaluated with
+double hermiteSoftening = 0.0;
+
+// SI scenario mode (see SI SCENARIO MODE): internal units per SI unit
+const double G_SI = 6.67430e-11;   // m³ kg⁻¹ s⁻²
+bool siMode = false;
+double unitLength = 1.0;    // m
+double unitMass = 1.0;      // kg
+double unitTime = 1.0;      // s
+double unitVelocity = 1.0;  // m/s
+double substepAccuracy = 0.01;   // eta: fraction of the shortest pair timescale
+double scaledG = 1.0;       // G to restore when leaving SI mode
+
 // NASA Game Mode parameters
 GameMode gameMode = GAME_MODE_DISABLED;
 MissionState missionState = MISSION_SETUP;
-int earthBodyIndex = -1;        // Index of Earth in bodies array
-int asteroidBodyIndex = -1;     // Index of threat asteroid
-int spacecraftBodyIndex = -1;   // Index of player's deflection spacecraft
+BodyHandle earthBody = NO_BODY;        // Handle of Earth
+BodyHandle asteroidBody = NO_BODY;     // Handle of threat asteroid
+BodyHandle spacecraftBody = NO_BODY;   // Handle of player's deflection spacecraft
+
+// Back to initialBodies as a new scene. Handles held outside the engine
+// stop resolving; the mission's handles move to the restored copies of
+// their bodies (or to NO_BODY if a body was added after the save).
+void restoreInitialBodies() {
+    BodyHandle* const missionBodies[] = { &earthBody, &asteroidBody, &spacecraftBody };
+    int savedIndex[3];
+    for (int k = 0; k < 3; k++) {
+        auto saved = std::find(initialBodyHandles.begin(), initialBodyHandles.end(), *missionBodies[k]);
+        savedIndex[k] = saved == initialBodyHandles.end() ? -1 : static_cast<int>(saved - initialBodyHandles.begin());
+    }
+    
+    clearBodyStore();
+    bodies = initialBodies;
+    initialBodyHandles.resize(bodies.size());
+    for (size_t i = 0; i < bodies.size(); i++) {
+        initialBodyHandles[i] = bodyHandle(i);
+        bodyHandleEntry(initialBodyHandles[i]).initial = static_cast<uint32_t>(i);
+    }
+    for (int k = 0; k < 3; k++) {
+        *missionBodies[k] = savedIndex[k] >= 0 ? initialBodyHandles[savedIndex[k]] : NO_BODY;
+    }
+}
 double earthRadius = 6371.0;    // Earth radius in km (scaled for display)
 double safetyMargin = 10.0;     // Required miss distance (Earth radii)
 double threatRadius = 50.0;     // Collision detection radius
@@ -110,10 +427,496 @@ double energyDrift = 0.0;
 double momentumDrift = 0.0;
 double angularMomentumDrift = 0.0;
 
+// Lazy diagnostics: the properties above are only recomputed when a getter
+// asks for them after the state changed (see ensureDiagnostics)
+bool diagnosticsDirty = true;
+bool baselinePending = false;   // Bulk loads defer the O(N²) baseline capture
+bool spatialIndexDirty = true;  // Body positions changed since the last index build
+unsigned long stateVersion = 0; // Bumped on every state change (steps and edits)
+double simulationTime = 0.0;    // Simulated time since the last saveInitialState()
+
+// Rolling drift statistics, sampled every driftSampleInterval steps
+struct DriftStats {
+    double max;
+    double timeOfMax;
+    double sumSq;
+    int samples;
+};
+int driftSampleInterval = 10;   // Steps between samples (0 = off)
+int stepsSinceDriftSample = 0;
+DriftStats energyDriftStats = {};
+DriftStats momentumDriftStats = {};
+DriftStats angularMomentumDriftStats = {};
+
+inline void markDiagnosticsDirty() {
+    diagnosticsDirty = true;
+    spatialIndexDirty = true;
+    stateVersion++;
+}
+
 // Canvas properties
 int canvasWidth = 800;
 int canvasHeight = 600;
 
+/**
+ * Render state: one flat frame of doubles (header + per-body records +
+ * test-particle records) that a Web Worker copies into shared memory after
+ * each step, so the render thread never has to call into WASM. Header
+ * fields not refreshed on a given call keep their previous values.
+ */
+enum RenderHeaderField {
+    RENDER_BODY_COUNT,
+    RENDER_SIMULATION_TIME,
+    RENDER_TIME_STEP,
+    RENDER_TOTAL_ENERGY,            // Diagnostics fields: refreshed only when
+    RENDER_MOMENTUM_X,              // requested (they cost an O(N²) pass)
+    RENDER_MOMENTUM_Y,
+    RENDER_MOMENTUM_Z,
+    RENDER_ANGULAR_MOMENTUM,
+    RENDER_ENERGY_DRIFT,
+    RENDER_MOMENTUM_DRIFT,
+    RENDER_ANGULAR_MOMENTUM_DRIFT,
+    RENDER_CENTER_OF_MASS_X,
+    RENDER_CENTER_OF_MASS_Y,
+    RENDER_CENTER_OF_MASS_Z,
+    RENDER_GAME_MODE,
+    RENDER_MISSION_STATE,
+    RENDER_TEST_PARTICLE_COUNT,     // Records after the body records
+    RENDER_HEADER_SIZE
+};
+
+// Per-body record: x, y, z, vx, vy, vz, mass, radius, color
+const int RENDER_BODY_STRIDE = 9;
+// Per-test-particle record: x, y, z
+const int RENDER_PARTICLE_STRIDE = 3;
+
+std::vector<double> renderState(RENDER_HEADER_SIZE, 0.0);
+
+/**
+ * Fixed-timestep frame pacing: advanceFrame() turns wall-clock time into
+ * whole dt steps (stepRate × timeScale steps per second, so speed no longer
+ * changes the step size) and keeps the leftover fraction as alpha. The
+ * interpolated render state shows the scene alpha of the way through the
+ * last step, using the snapshot taken just before it.
+ */
+double stepRate = 300.0;            // Steps per wall-clock second at timeScale 1
+int maxStepsPerFrame = 250;         // Spiral-of-death guard
+double frameAccumulator = 0.0;      // Pending steps (fractional)
+double lastFrameStep = 0.0;         // Step size of the last advanceFrame() step
+long droppedSteps = 0;              // Backlog discarded by the guard
+std::vector<Body> previousBodies;   // State before the last advanceFrame() step
+unsigned long interpolationVersion = 0;   // stateVersion right after that step
+
+/**
+ * Cubic Hermite interpolation between two states h apart, at fraction s:
+ * matches positions and velocities at both ends, so it is exact for
+ * motion under constant acceleration and smooth across steps.
+ */
+inline void hermiteInterpolate(const Body& a, const Body& b, double h, double s, double pos[3], double vel[3]) {
+    double s2 = s * s;
+    double s3 = s2 * s;
+    double h00 = 2.0 * s3 - 3.0 * s2 + 1.0;
+    double h10 = s3 - 2.0 * s2 + s;
+    double h01 = -2.0 * s3 + 3.0 * s2;
+    double h11 = s3 - s2;
+    // Basis derivatives with respect to s (position terms divided by h below)
+    double d00 = 6.0 * s2 - 6.0 * s;
+    double d10 = 3.0 * s2 - 4.0 * s + 1.0;
+    double d11 = 3.0 * s2 - 2.0 * s;
+    
+    const double pa[3] = { a.x, a.y, a.z };
+    const double va[3] = { a.vx, a.vy, a.vz };
+    const double pb[3] = { b.x, b.y, b.z };
+    const double vb[3] = { b.vx, b.vy, b.vz };
+    for (int k = 0; k < 3; k++) {
+        pos[k] = h00 * pa[k] + h10 * h * va[k] + h01 * pb[k] + h11 * h * vb[k];
+        vel[k] = (h > 0.0) ? d00 * (pa[k] - pb[k]) / h + d10 * va[k] + d11 * vb[k] : vb[k];
+    }
+}
+
+/**
+ * PROFILING: per-phase timers and hot-path counters
+ * 
+ * Scoped timers accumulate wall time per phase; build with
+ * -DTHREEBODY_PROFILING=0 to compile every timer and counter out.
+ * Phases nest: integration includes the force and collision time spent
+ * inside it. Read everything through getPerfStats().
+ */
+#ifndef THREEBODY_PROFILING
+#define THREEBODY_PROFILING 1
+#endif
+
+enum PerfPhase {
+    PHASE_FORCES,        // calculateForces + RK stage evaluations
+    PHASE_COLLISIONS,    // handleCollisions
+    PHASE_INTEGRATION,   // whole integrator step
+    PHASE_DIAGNOSTICS,   // calculateSystemProperties
+    PHASE_MISSION,       // evaluateMissionStatus
+    PHASE_COUNT
+};
+
+const char* const perfPhaseNames[PHASE_COUNT] = {
+    "forces", "collisions", "integration", "diagnostics", "mission"
+};
+
+// Flat layout of doubles so JS can view it as a Float64Array
+struct PerfStats {
+    double phaseTotalMs[PHASE_COUNT];  // Accumulated since resetPerfStats()
+    double phaseLastMs[PHASE_COUNT];   // Time spent in the most recent step
+    double phaseCalls[PHASE_COUNT];
+    double steps;
+    double pairInteractions;           // Pairwise force evaluations
+    double collisions;                 // Overlapping pairs resolved
+    double merges;                     // Of which merged
+    double rkf45Rejections;            // RKF45 body updates over rkfTolerance
+};
+
+PerfStats perfStats = {};
+PerfStats perfStatsSnapshot = {};
+double perfStepMs[PHASE_COUNT] = {};   // Per-phase time within the current step
+
+double perfNowMs() {
+#ifdef __EMSCRIPTEN__
+    return emscripten_get_now();
+#else
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+#ifndef __EMSCRIPTEN__
+// Native runs can record every timed scope as a Chrome trace event
+// (load the file in chrome://tracing or Perfetto)
+struct PerfTraceEvent {
+    PerfPhase phase;
+    double startMs;
+    double durationMs;
+};
+bool perfTraceEnabled = false;
+double perfTraceOriginMs = 0.0;
+std::vector<PerfTraceEvent> perfTraceEvents;
+const size_t MAX_PERF_TRACE_EVENTS = 1u << 20;
+
+void setPerfTrace(bool enabled) {
+    perfTraceEnabled = enabled;
+    perfTraceEvents.clear();
+    perfTraceOriginMs = perfNowMs();
+}
+
+bool writePerfTrace(const char* path) {
+    FILE* file = fopen(path, "w");
+    if (!file) return false;
+    fprintf(file, "{\"traceEvents\":[\n");
+    for (size_t i = 0; i < perfTraceEvents.size(); i++) {
+        const PerfTraceEvent& event = perfTraceEvents[i];
+        fprintf(file, "{\"name\":\"%s\",\"cat\":\"physics\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":1}%s\n",
+                perfPhaseNames[event.phase], (event.startMs - perfTraceOriginMs) * 1000.0,
+                event.durationMs * 1000.0, i + 1 < perfTraceEvents.size() ? "," : "");
+    }
+    fprintf(file, "],\"displayTimeUnit\":\"ms\"}\n");
+    fclose(file);
+    return true;
+}
+#endif
+
+#if THREEBODY_PROFILING
+class ScopedPhaseTimer {
+public:
+    explicit ScopedPhaseTimer(PerfPhase phase) : phase(phase), startMs(perfNowMs()) {}
+    ~ScopedPhaseTimer() {
+        double elapsed = perfNowMs() - startMs;
+        perfStats.phaseTotalMs[phase] += elapsed;
+        perfStats.phaseCalls[phase] += 1.0;
+        perfStepMs[phase] += elapsed;
+#ifndef __EMSCRIPTEN__
+        if (perfTraceEnabled && perfTraceEvents.size() < MAX_PERF_TRACE_EVENTS) {
+            perfTraceEvents.push_back({phase, startMs, elapsed});
+        }
+#endif
+    }
+private:
+    PerfPhase phase;
+    double startMs;
+};
+#define PROFILE_PHASE(phase) ScopedPhaseTimer profilePhaseTimer(phase)
+#define PROFILE_COUNT(counter, amount) (perfStats.counter += (amount))
+#else
+#define PROFILE_PHASE(phase) ((void)0)
+#define PROFILE_COUNT(counter, amount) ((void)0)
+#endif
+
+// Close out a simulation step: publish per-step phase times
+void finishPerfStep() {
+#if THREEBODY_PROFILING
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        perfStats.phaseLastMs[i] = perfStepMs[i];
+        perfStepMs[i] = 0.0;
+    }
+    perfStats.steps += 1.0;
+#endif
+}
+
+/**
+ * TASK SCHEDULER: work-stealing worker pool for the large-N phases
+ * 
+ * Each worker owns a bounded task deque; the calling thread is worker 0.
+ * A worker pushes and pops at the bottom of its own deque. An idle worker
+ * steals from the top of another's, so whoever finishes early takes the
+ * oldest pending work of a slower worker. A task is a plain
+ * (group, range, chunk) record. Its group counts unfinished tasks, and
+ * whoever waits on a group keeps running tasks until it drains, so
+ * nested fork-join (the k-d tree build) cannot deadlock.
+ * 
+ * parallelFor() cuts [0, count) into chunks from the TaskCosts of its call
+ * site. It measures each chunk's wall time, and the next call over the
+ * same count puts the boundaries at equal quantiles of that measured cost
+ * (taken as uniform within each old chunk). Triangular pair loops and
+ * tree walks through dense cores therefore get narrow chunks where the
+ * work is, and stealing absorbs the imbalance that remains.
+ * 
+ * Without threads (the default WebAssembly build, or -DTHREEBODY_THREADS=0)
+ * no workers start, and every parallel phase runs its whole range inline
+ * in the original order.
+ */
+const int MAX_WORKERS = 16;
+const int MAX_TASK_CHUNKS = 64;
+const size_t TASK_QUEUE_CAPACITY = 256;
+const size_t PARALLEL_MIN_BODIES = 512;   // Below this the phases stay serial
+
+// Measured cost profile of one parallelFor() call site
+struct TaskCosts {
+    size_t count = 0;                     // Range the boundaries were cut for
+    int chunks = 0;
+    size_t bounds[MAX_TASK_CHUNKS + 1];
+    double ms[MAX_TASK_CHUNKS];           // Wall time of each chunk, last run
+};
+
+struct TaskGroup {
+    void (*run)(void* context, TaskGroup& group, size_t begin, size_t end);
+    void* context;
+    TaskCosts* costs;                     // nullptr: chunks are not timed
+    std::atomic<int> pending{0};
+};
+
+struct Task {
+    TaskGroup* group;
+    size_t begin, end;
+    int chunk;                            // Index into group->costs, -1 = untimed
+};
+
+struct TaskQueue {
+    std::mutex lock;
+    Task tasks[TASK_QUEUE_CAPACITY];
+    size_t top = 0;                       // Oldest task: thieves take it
+    size_t bottom = 0;                    // Owner pushes and pops here
+};
+
+TaskQueue taskQueues[MAX_WORKERS];
+std::vector<std::thread> workerPool;
+int workerCount = 0;                      // workerPool.size(), fixed before any worker starts
+std::mutex workerSleepLock;
+std::condition_variable workerWake;
+std::atomic<int> queuedTasks{0};
+std::atomic<bool> workersStopping{false};
+std::atomic<long> tasksStolen{0};
+thread_local int currentWorker = 0;
+int requestedWorkers = -1;                // Threads besides the caller, -1 = one per core
+bool workersStarted = false;
+
+bool pushTask(const Task& task) {
+    TaskQueue& queue = taskQueues[currentWorker];
+    std::lock_guard<std::mutex> guard(queue.lock);
+    if (queue.bottom - queue.top == TASK_QUEUE_CAPACITY) return false;
+    queue.tasks[queue.bottom++ % TASK_QUEUE_CAPACITY] = task;
+    queuedTasks.fetch_add(1);
+    return true;
+}
+
+// Own deque first (newest task, still warm in cache), then steal the
+// oldest task of the next non-empty victim
+bool findTask(Task& task) {
+    const int workers = 1 + workerCount;
+    for (int k = 0; k < workers; k++) {
+        const int victim = (currentWorker + k) % workers;
+        TaskQueue& queue = taskQueues[victim];
+        std::lock_guard<std::mutex> guard(queue.lock);
+        if (queue.top == queue.bottom) continue;
+        if (k == 0) {
+            task = queue.tasks[--queue.bottom % TASK_QUEUE_CAPACITY];
+        } else {
+            task = queue.tasks[queue.top++ % TASK_QUEUE_CAPACITY];
+            tasksStolen.fetch_add(1, std::memory_order_relaxed);
+        }
+        queuedTasks.fetch_sub(1);
+        return true;
+    }
+    return false;
+}
+
+void runTask(const Task& task) {
+    TaskGroup& group = *task.group;
+    const double start = task.chunk >= 0 ? perfNowMs() : 0.0;
+    group.run(group.context, group, task.begin, task.end);
+    if (task.chunk >= 0) {
+        group.costs->ms[task.chunk] = perfNowMs() - start;
+    }
+    group.pending.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+void wakeWorkers() {
+    // Taking the lock orders the queuedTasks update before any waiter's check
+    { std::lock_guard<std::mutex> guard(workerSleepLock); }
+    workerWake.notify_all();
+}
+
+void workerLoop(int index) {
+    currentWorker = index;
+    Task task;
+    while (!workersStopping.load()) {
+        if (findTask(task)) {
+            runTask(task);
+            continue;
+        }
+        std::unique_lock<std::mutex> sleep(workerSleepLock);
+        workerWake.wait(sleep, [] { return queuedTasks.load() > 0 || workersStopping.load(); });
+    }
+}
+
+// Help with any queued work until every task of the group has finished
+void waitForGroup(TaskGroup& group) {
+    Task task;
+    while (group.pending.load(std::memory_order_acquire) > 0) {
+        if (findTask(task)) {
+            runTask(task);
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void stopWorkers() {
+    workersStopping = true;
+    wakeWorkers();
+    for (auto& worker : workerPool) {
+        worker.join();
+    }
+    workerPool.clear();
+    workerCount = 0;
+    workersStopping = false;
+    workersStarted = false;
+}
+
+// Workers including the caller; the pool starts on first use
+int activeWorkers() {
+    if (!workersStarted) {
+        workersStarted = true;
+        int count = requestedWorkers;
+        if (count < 0) {
+            count = static_cast<int>(std::thread::hardware_concurrency()) - 1;
+        }
+        count = THREEBODY_THREADS ? std::max(0, std::min(count, MAX_WORKERS - 1)) : 0;
+        static bool exitHook = false;
+        if (count > 0 && !exitHook) {
+            std::atexit(stopWorkers);   // Join before the pool is destroyed
+            exitHook = true;
+        }
+        workerCount = count;
+        for (int i = 1; i <= count; i++) {
+            workerPool.emplace_back(workerLoop, i);
+        }
+    }
+    return 1 + workerCount;
+}
+
+// Boundaries for `chunks` chunks of [0, count): equal measured cost when
+// the last run covered the same count, equal sizes otherwise
+void planChunks(TaskCosts& costs, size_t count, size_t minChunk, int chunks) {
+    chunks = static_cast<int>(std::max<size_t>(1, std::min<size_t>(chunks, count / std::max<size_t>(minChunk, 1))));
+    double total = 0.0;
+    const bool measured = costs.count == count && costs.chunks > 0;
+    if (measured) {
+        for (int c = 0; c < costs.chunks; c++) {
+            costs.ms[c] = std::max(costs.ms[c], 1e-6);
+            total += costs.ms[c];
+        }
+    }
+    
+    size_t bounds[MAX_TASK_CHUNKS + 1];
+    bounds[0] = 0;
+    int old = 0;
+    double before = 0.0;   // Cost of old chunks ahead of `old`
+    for (int k = 1; k < chunks; k++) {
+        if (!measured) {
+            bounds[k] = count * k / chunks;
+            continue;
+        }
+        const double target = total * k / chunks;
+        while (old < costs.chunks - 1 && before + costs.ms[old] < target) {
+            before += costs.ms[old++];
+        }
+        const double width = static_cast<double>(costs.bounds[old + 1] - costs.bounds[old]);
+        const double at = costs.bounds[old] + width * std::min(1.0, (target - before) / costs.ms[old]);
+        bounds[k] = std::max(bounds[k - 1], std::min(count, static_cast<size_t>(at)));
+    }
+    bounds[chunks] = count;
+    
+    // Drop empty chunks
+    int kept = 0;
+    costs.bounds[0] = 0;
+    for (int k = 1; k <= chunks; k++) {
+        if (bounds[k] > costs.bounds[kept]) {
+            costs.bounds[++kept] = bounds[k];
+            costs.ms[kept - 1] = 0.0;
+        }
+    }
+    costs.chunks = kept;
+    costs.count = count;
+}
+
+/**
+ * fn(begin, end) over chunks of [0, count) on every worker, returning when
+ * all are done. Chunks hold at least minChunk items; fn must only write
+ * state owned by its range (or per-worker scratch, see currentWorker).
+ */
+template <typename Fn>
+void parallelFor(TaskCosts& costs, size_t count, size_t minChunk, Fn&& fn) {
+    const int workers = activeWorkers();
+    if (workers == 1 || count < 2 * minChunk) {
+        fn(static_cast<size_t>(0), count);
+        return;
+    }
+    planChunks(costs, count, minChunk, std::min(MAX_TASK_CHUNKS, 4 * workers));
+    
+    using Callable = std::remove_reference_t<Fn>;
+    TaskGroup group;
+    group.run = [](void* context, TaskGroup&, size_t begin, size_t end) {
+        (*static_cast<Callable*>(context))(begin, end);
+    };
+    group.context = const_cast<void*>(static_cast<const void*>(&fn));
+    group.costs = &costs;
+    group.pending = costs.chunks;
+    // Last chunk first: the owner pops chunk 0 while thieves take the far end
+    for (int c = costs.chunks - 1; c >= 0; c--) {
+        Task task = { &group, costs.bounds[c], costs.bounds[c + 1], c };
+        if (!pushTask(task)) runTask(task);
+    }
+    wakeWorkers();
+    waitForGroup(group);
+}
+
+// Fork [begin, end) of a fork-join group onto this worker's deque (runs
+// inline without workers or when the deque is full)
+void spawnTask(TaskGroup& group, size_t begin, size_t end) {
+    if (workerCount > 0) {
+        group.pending.fetch_add(1);
+        if (pushTask({ &group, begin, end, -1 })) {
+            wakeWorkers();
+            return;
+        }
+        group.pending.fetch_sub(1);
+    }
+    group.run(group.context, group, begin, end);
+}
+
 // Preset configurations
 enum PresetType {
     PRESET_FIGURE_EIGHT,        // Classic 3-body equal mass
@@ -132,7 +935,7 @@ enum PresetType {
 // This is a stable periodic orbit where three equal masses chase each other
 // Classic three-body problem solution with m1 = m2 = m3
 void loadFigureEight() {
-    bodies.clear();
+    clearBodyStore();
     
     // Figure-eight initial conditions (scaled for visualization)
     // Equal masses - fundamental to classical three-body problem
@@ -168,7 +971,7 @@ void loadFigureEight() {
 
 // Preset: Stable circular orbit system
 void loadStableOrbit() {
-    bodies.clear();
+    clearBodyStore();
     
     // Central massive body (Sun-like - scaled mass)
     bodies.push_back({
@@ -209,7 +1012,7 @@ void loadStableOrbit() {
 
 // Preset: Chaotic system
 void loadChaotic() {
-    bodies.clear();
+    clearBodyStore();
     
     // Using planetary masses for chaotic interactions
     bodies.push_back({
@@ -242,7 +1045,7 @@ void loadChaotic() {
 
 // Preset: Binary star system with planet
 void loadBinaryStar() {
-    bodies.clear();
+    clearBodyStore();
     
     // Binary star system - two stars orbiting their barycenter
     // Star 1 (Yellow star - scaled solar mass)
@@ -278,7 +1081,7 @@ void loadBinaryStar() {
 
 // Preset: Pythagorean three-body problem
 void loadPythagorean() {
-    bodies.clear();
+    clearBodyStore();
     
     // Classic Pythagorean problem: masses in ratio 3:4:5
     // Using gas giant masses
@@ -314,7 +1117,7 @@ void loadPythagorean() {
 // Classic three-body solution where bodies orbit in equilateral triangle
 // One of the simplest periodic solutions to the three-body problem
 void loadLagrange() {
-    bodies.clear();
+    clearBodyStore();
     
     // Three equal masses at vertices of equilateral triangle
     // Rotating about their common center of mass
@@ -362,7 +1165,7 @@ void loadLagrange() {
 // Uses realistic planetary mass ratios (Earth = 1.0)
 // Sun ≈ 333,000 Earth masses (scaled down for simulation stability)
 void loadSolarSystem() {
-    bodies.clear();
+    clearBodyStore();
     
     // Sun at center (mass scaled to 1000 for simulation)
     bodies.push_back({
@@ -486,7 +1289,7 @@ void loadSolarSystem() {
  * Realistic three-body problem with mission objectives
  */
 void loadNASAAsteroidDefense(int difficulty) {
-    bodies.clear();
+    clearBodyStore();
     gameMode = GAME_MODE_ACTIVE;
     missionState = MISSION_SETUP;
     missionTime = 0.0;
@@ -505,7 +1308,7 @@ void loadNASAAsteroidDefense(int difficulty) {
         0x4A90E2FF,            // Earth blue
         0.0, 0.0
     });
-    earthBodyIndex = 0;
+    earthBody = bodyHandle(bodies.size() - 1);
     
     // Incoming asteroid - difficulty determines speed and angle
     double asteroidDistance = 300.0;  // Starting distance
@@ -560,10 +1363,11 @@ void loadNASAAsteroidDefense(int difficulty) {
         0xA0522DFF,            // Brown asteroid
         0.0, 0.0
     });
-    asteroidBodyIndex = 1;
+    asteroidBody = bodyHandle(bodies.size() - 1);
     
     // No spacecraft yet - player will deploy it
-    spacecraftBodyIndex = -1;
+    spacecraftBody = NO_BODY;
+    markDiagnosticsDirty();
     
     printf("NASA Asteroid Defense Mission Started - Difficulty: %d\\n", difficulty);
     printf("Objective: Deflect asteroid using gravity or kinetic impact\\n");
@@ -575,11 +1379,26 @@ void initBodies() {
     loadFigureEight(); // Default to figure-eight
 }
 
+// Feature bits folded out of the runtime toggles by selectKernels(), so the
+// pair loop never tests them itself. Tidal, GW, drag and 1PN terms are not
+// kernel features: they run as separate passes (see FORCE TERMS).
+enum ForceFeature : unsigned {
+    FORCE_SOFTENING = 1u << 0,   // softeningLength > 0
+    FORCE_FEATURE_COMBINATIONS = 1u << 1
+};
+
+// Largest body count with a dedicated, fully unrolled instantiation
+const int MAX_SPECIALIZED_BODIES = 4;
+
+template <unsigned Features>
+void gatherForceRows(size_t begin, size_t end);
+TaskCosts forceCosts;
+
 /**
- * PHYSICS: Gravitational Force Calculation
+ * PHYSICS: Gravitational Force Calculation (3D)
  * 
- * Newton's Law of Universal Gravitation:
- * F = G * (m1 * m2) / r²
+ * Newton's Law of Universal Gravitation (PDF equations 1-4):
+ * F = G * m1 * m2 / r²
  * 
  * Where:
  * - G is the gravitational constant
@@ -588,43 +1407,54 @@ void initBodies() {
  * 
  * The force is a vector pointing from one mass to the other:
  * F_vec = F * (r_vec / |r_vec|)
- */
-/**
- * PHYSICS: Gravitational Force Calculation (3D)
- * 
- * Newton's Law of Universal Gravitation (PDF equations 1-4):
- * F = G * m1 * m2 / r²
  * 
  * Optional Plummer softening to prevent singularities:
  * F = G * m1 * m2 / (r² + ε²)^(3/2)
  * 
  * Softening length ε prevents infinite forces at r→0 (disabled by default)
- * Also includes optional tidal force approximation
+ * 
+ * Specialized at compile time: N > 0 gives the loops a constant trip count
+ * (fully unrolled by the optimizer for the canonical 2/3/4-body cases),
+ * N == 0 is the generic path, and disabled features drop out via if constexpr.
  */
-void calculateForces() {
+template <int N, unsigned Features>
+void calculateForcesKernel() {
+    const size_t n = N > 0 ? static_cast<size_t>(N) : bodies.size();
+    if constexpr (N == 0) {
+        if (n >= PARALLEL_MIN_BODIES && activeWorkers() > 1) {
+            parallelFor(forceCosts, n, 64, [](size_t begin, size_t end) {
+                gatherForceRows<Features>(begin, end);
+            });
+            return;
+        }
+    }
+    Body* b = bodies.data();
+    const double softeningSq = softeningLength * softeningLength;
+    
     // Reset accelerations
-    for (auto& body : bodies) {
-        body.ax = 0.0;
-        body.ay = 0.0;
-        body.az = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        b[i].ax = 0.0;
+        b[i].ay = 0.0;
+        b[i].az = 0.0;
     }
     
     // Calculate forces between all pairs (O(n²) algorithm)
-    for (size_t i = 0; i < bodies.size(); i++) {
-        for (size_t j = i + 1; j < bodies.size(); j++) {
-            double dx = bodies[j].x - bodies[i].x;
-            double dy = bodies[j].y - bodies[i].y;
-            double dz = bodies[j].z - bodies[i].z;
+    for (size_t i = 0; i < n; i++) {
+        for (size_t j = i + 1; j < n; j++) {
+            double dx = b[j].x - b[i].x;
+            double dy = b[j].y - b[i].y;
+            double dz = b[j].z - b[i].z;
             double distSq = dx * dx + dy * dy + dz * dz;
-            double dist = sqrt(distSq);
             
             // Optional Plummer softening: F = G*m1*m2 / (r² + ε²)^(3/2)
-            // Only applied if softeningLength > 0
-            double softenedDistSq = distSq + softeningLength * softeningLength;
+            double softenedDistSq = distSq;
+            if constexpr ((Features & FORCE_SOFTENING) != 0) {
+                softenedDistSq = distSq + softeningSq;
+            }
             double softenedDist = sqrt(softenedDistSq);
             
             // Gravitational force magnitude
-            double forceMag = G * bodies[i].mass * bodies[j].mass / softenedDistSq;
+            double forceMag = G * b[i].mass * b[j].mass / softenedDistSq;
             
             // Force components (3D)
             double fx = forceMag * dx / softenedDist;
@@ -632,79 +1462,837 @@ void calculateForces() {
             double fz = forceMag * dz / softenedDist;
             
             // Apply forces (Newton's 2nd & 3rd laws: F = ma, F_ij = -F_ji)
-            bodies[i].ax += fx / bodies[i].mass;
-            bodies[i].ay += fy / bodies[i].mass;
-            bodies[i].az += fz / bodies[i].mass;
-            bodies[j].ax -= fx / bodies[j].mass;
-            bodies[j].ay -= fy / bodies[j].mass;
-            bodies[j].az -= fz / bodies[j].mass;
-            
-            // Optional: Tidal forces (quadrupole approximation)
-            // Causes tidal deformation and heating
-            if (enableTidalForces && dist < bodies[i].radius * 5 && dist < bodies[j].radius * 5) {
-                // Tidal acceleration ~ G*M*R/r³ (simplified)
-                double tidalFactor = 0.01; // Damping factor
-                double tidalAccel1 = tidalFactor * G * bodies[j].mass * bodies[i].radius / (dist * dist * dist);
-                double tidalAccel2 = tidalFactor * G * bodies[i].mass * bodies[j].radius / (dist * dist * dist);
-                
-                // Apply small damping to simulate tidal dissipation
-                bodies[i].vx *= (1.0 - tidalAccel1 * dt * 0.001);
-                bodies[i].vy *= (1.0 - tidalAccel1 * dt * 0.001);
-                bodies[i].vz *= (1.0 - tidalAccel1 * dt * 0.001);
-                bodies[j].vx *= (1.0 - tidalAccel2 * dt * 0.001);
-                bodies[j].vy *= (1.0 - tidalAccel2 * dt * 0.001);
-                bodies[j].vz *= (1.0 - tidalAccel2 * dt * 0.001);
-            }
-            
-            // Optional: Gravitational wave energy loss (post-Newtonian)
-            // dE/dt = -(32/5) * G⁴/c⁵ * (m1*m2)²*(m1+m2)/r⁵
-            if (enableGravitationalWaves && dist < 100.0) {
-                double c = 300.0; // Speed of light (scaled)
-                double m1m2 = bodies[i].mass * bodies[j].mass;
-                double gwFactor = (32.0/5.0) * pow(G, 4) / pow(c, 5);
-                double energyLoss = gwFactor * m1m2 * m1m2 * (bodies[i].mass + bodies[j].mass) / pow(dist, 5);
-                
-                // Apply energy loss as velocity damping
-                double dampingFactor = 1.0 - energyLoss * dt * 0.0001;
-                bodies[i].vx *= dampingFactor;
-                bodies[i].vy *= dampingFactor;
-                bodies[i].vz *= dampingFactor;
-                bodies[j].vx *= dampingFactor;
-                bodies[j].vy *= dampingFactor;
-                bodies[j].vz *= dampingFactor;
+            b[i].ax += fx / b[i].mass;
+            b[i].ay += fy / b[i].mass;
+            b[i].az += fz / b[i].mass;
+            b[j].ax -= fx / b[j].mass;
+            b[j].ay -= fy / b[j].mass;
+            b[j].az -= fz / b[j].mass;
+        }
+    }
+}
+
+/**
+ * Parallel form of the generic kernel: each task owns a range of rows and
+ * gathers a_i = Σ_j G m_j r_ij / |r_ij|³ over every j, so no two tasks
+ * write the same body. That is twice the pair evaluations of the i < j
+ * loop (no Newton's-third-law reuse), repaid from two workers on. Rows
+ * are summed in a fixed order, so the result does not depend on how the
+ * range was chunked; it rounds differently from the serial loop.
+ */
+template <unsigned Features>
+void gatherForceRows(size_t begin, size_t end) {
+    const size_t n = bodies.size();
+    Body* b = bodies.data();
+    const double softeningSq = softeningLength * softeningLength;
+    
+    for (size_t i = begin; i < end; i++) {
+        const double xi = b[i].x, yi = b[i].y, zi = b[i].z;
+        double ax = 0.0, ay = 0.0, az = 0.0;
+        for (size_t j = 0; j < n; j++) {
+            double dx = b[j].x - xi;
+            double dy = b[j].y - yi;
+            double dz = b[j].z - zi;
+            double distSq = dx * dx + dy * dy + dz * dz;
+            if constexpr ((Features & FORCE_SOFTENING) != 0) {
+                distSq += softeningSq;
             }
+            // The self-pair contributes nothing (dx = dy = dz = 0)
+            double invDist = distSq > 0.0 ? 1.0 / sqrt(distSq) : 0.0;
+            double scale = G * b[j].mass * invDist * invDist * invDist;
+            ax += scale * dx;
+            ay += scale * dy;
+            az += scale * dz;
         }
+        b[i].ax = ax;
+        b[i].ay = ay;
+        b[i].az = az;
     }
 }
 
+typedef void (*ForceKernel)();
+
+template <int N, unsigned... Features>
+constexpr std::array<ForceKernel, sizeof...(Features)> makeForceKernelRow(std::integer_sequence<unsigned, Features...>) {
+    return {{ &calculateForcesKernel<N, Features>... }};
+}
+
+template <int N>
+constexpr std::array<ForceKernel, FORCE_FEATURE_COMBINATIONS> forceKernelRow() {
+    return makeForceKernelRow<N>(std::make_integer_sequence<unsigned, FORCE_FEATURE_COMBINATIONS>{});
+}
+
+// Indexed by [body count][feature mask]; rows 0 and 1 use the generic kernel
+const std::array<ForceKernel, FORCE_FEATURE_COMBINATIONS> forceKernelTable[MAX_SPECIALIZED_BODIES + 1] = {
+    forceKernelRow<0>(), forceKernelRow<0>(), forceKernelRow<2>(), forceKernelRow<3>(), forceKernelRow<4>()
+};
+
 /**
- * PHYSICS: Collision Detection and Response (3D)
+ * PERFORMANCE: Mixed-Precision Force Kernel
  * 
- * Realistic collision mechanics:
- * 1. Conservation of linear momentum: m1*v1 + m2*v2 = (m1+m2)*v_final
- * 2. Conservation of angular momentum: L1 + L2 = L_final
- * 3. Energy dissipation through coefficient of restitution
+ * Opt-in for large-N visual runs (setMixedPrecision). Bodies are taken in
+ * blocks of PRECISION_BLOCK_SIZE and re-expressed as float offsets from their
+ * block's centroid, so a pair separation
+ *   d = (O_J - O_I) + (r_j - O_J) - (r_i - O_I)
+ * is formed in float32 from small numbers: the error scales with the block
+ * extent, not with the distance from the coordinate origin.
+ * 
+ * Each target/source block tile is summed in float with the target index
+ * innermost (contiguous, no reduction, twice the SIMD lanes of the double
+ * loop); tile totals are accumulated into double accelerations, and
+ * positions and velocities stay double throughout.
+ * 
+ * Only Newtonian gravity (optionally softened) is covered; the optional
+ * terms run afterwards as usual (FORCE TERMS). The RK4/RKF45 stage
+ * evaluations keep the double kernels.
+ */
+TaskCosts mixedForceCosts;
+
+template <bool Softened>
+void calculateForcesMixedKernel() {
+    const size_t n = bodies.size();
+    Body* b = bodies.data();
+    const size_t blocks = (n + PRECISION_BLOCK_SIZE - 1) / PRECISION_BLOCK_SIZE;
+    const float softeningSq = static_cast<float>(softeningLength * softeningLength);
+    
+    std::vector<float>& local = stepScratch.localBodies;
+    std::vector<double>& origins = stepScratch.blockOrigins;
+    local.resize(4 * n);
+    origins.resize(3 * blocks);
+    float* lx = local.data();
+    float* ly = lx + n;
+    float* lz = ly + n;
+    float* lgm = lz + n;
+    
+    // Block centroids (double) and per-body offsets from them (float)
+    for (size_t block = 0; block < blocks; block++) {
+        size_t begin = block * PRECISION_BLOCK_SIZE;
+        size_t end = std::min(n, begin + PRECISION_BLOCK_SIZE);
+        double ox = 0.0, oy = 0.0, oz = 0.0;
+        for (size_t i = begin; i < end; i++) {
+            ox += b[i].x;
+            oy += b[i].y;
+            oz += b[i].z;
+        }
+        double inv = 1.0 / static_cast<double>(end - begin);
+        ox *= inv;
+        oy *= inv;
+        oz *= inv;
+        origins[3 * block] = ox;
+        origins[3 * block + 1] = oy;
+        origins[3 * block + 2] = oz;
+        for (size_t i = begin; i < end; i++) {
+            lx[i] = static_cast<float>(b[i].x - ox);
+            ly[i] = static_cast<float>(b[i].y - oy);
+            lz[i] = static_cast<float>(b[i].z - oz);
+            lgm[i] = static_cast<float>(G * b[i].mass);
+        }
+    }
+    
+    // Target blocks are independent: one task per range of blocks
+    parallelFor(mixedForceCosts, blocks, 1, [&](size_t blockBegin, size_t blockEnd) {
+        for (size_t bi = blockBegin; bi < blockEnd; bi++) {
+            const size_t iBegin = bi * PRECISION_BLOCK_SIZE;
+            const size_t count = std::min(n, iBegin + PRECISION_BLOCK_SIZE) - iBegin;
+            const float* ix = lx + iBegin;
+            const float* iy = ly + iBegin;
+            const float* iz = lz + iBegin;
+            double accX[PRECISION_BLOCK_SIZE] = {};
+            double accY[PRECISION_BLOCK_SIZE] = {};
+            double accZ[PRECISION_BLOCK_SIZE] = {};
+            
+            for (size_t bj = 0; bj < blocks; bj++) {
+                const size_t jBegin = bj * PRECISION_BLOCK_SIZE;
+                const size_t jEnd = std::min(n, jBegin + PRECISION_BLOCK_SIZE);
+                // Origin offset in double, rounded once; the rest is block-local
+                const float shiftX = static_cast<float>(origins[3 * bj] - origins[3 * bi]);
+                const float shiftY = static_cast<float>(origins[3 * bj + 1] - origins[3 * bi + 1]);
+                const float shiftZ = static_cast<float>(origins[3 * bj + 2] - origins[3 * bi + 2]);
+                float tileX[PRECISION_BLOCK_SIZE] = {};
+                float tileY[PRECISION_BLOCK_SIZE] = {};
+                float tileZ[PRECISION_BLOCK_SIZE] = {};
+                
+                for (size_t j = jBegin; j < jEnd; j++) {
+                    const float sx = shiftX + lx[j];
+                    const float sy = shiftY + ly[j];
+                    const float sz = shiftZ + lz[j];
+                    const float gm = lgm[j];
+                    for (size_t k = 0; k < count; k++) {
+                        float dx = sx - ix[k];
+                        float dy = sy - iy[k];
+                        float dz = sz - iz[k];
+                        float distSq = dx * dx + dy * dy + dz * dz;
+                        if constexpr (Softened) {
+                            distSq += softeningSq;
+                        }
+                        // Self-pair (and exactly coincident bodies) contribute nothing
+                        float invDist = distSq > 0.0f ? 1.0f / sqrtf(distSq) : 0.0f;
+                        float scale = gm * invDist * invDist * invDist;
+                        tileX[k] += scale * dx;
+                        tileY[k] += scale * dy;
+                        tileZ[k] += scale * dz;
+                    }
+                }
+                for (size_t k = 0; k < count; k++) {
+                    accX[k] += tileX[k];
+                    accY[k] += tileY[k];
+                    accZ[k] += tileZ[k];
+                }
+            }
+            
+            for (size_t k = 0; k < count; k++) {
+                b[iBegin + k].ax = accX[k];
+                b[iBegin + k].ay = accY[k];
+                b[iBegin + k].az = accZ[k];
+            }
+        }
+    });
+}
+
+/**
+ * PARTICLE-MESH GRAVITY: FFT Poisson solver for very large N
+ * 
+ * Alternative to the direct sum for 10^5-10^6 particle disks and clusters
+ * where smooth forces are enough (setParticleMesh). Each evaluation:
+ *   1. Fit a cubic M³ grid around the bodies (cell size h)
+ *   2. Deposit mass with cloud-in-cell (CIC) weights
+ *   3. Solve Poisson's equation by convolving with the Green's function
+ *      -G / r in Fourier space. The grid is zero-padded to (2M)³ so the
+ *      periodic FFT convolution equals the isolated (open-boundary) one
+ *      (Hockney & Eastwood); the Green's transform is cached per M.
+ *   4. a = -∇φ by central differences on the grid, interpolated back to
+ *      the bodies with the same CIC weights (no self-force)
+ * Cost is O(N + M³ log M). Forces are softened at about one cell, so
+ * close encounters are not resolved; there is no short-range (P3M)
+ * correction. Used by Euler and Verlet; the optional force terms still run
+ * as direct passes afterwards.
+ */
+bool particleMeshEnabled = false;
+// Grid cells per side (power of two, at most 128). The padded buffers take
+// 24 * (2M)³ bytes: 48 MiB at 64, 384 MiB at 128 (256 would need 3 GiB,
+// past the WebAssembly heap limit)
+int meshSize = 64;
+const int MAX_MESH_SIZE = 128;
+const size_t MESH_LINE_BATCH = 8;   // x lines transformed together
+
+struct ParticleMesh {
+    int size = 0;                               // M the buffers were built for
+    std::vector<std::complex<double>> grid;     // (2M)³ padded density / potential
+    std::vector<double> greenHat;               // FFT of the padded 1/r kernel, / (2M)³
+    std::vector<std::complex<double>> twiddles; // e^(-2πik/2M), k < M
+    std::vector<std::complex<double>> inverseTwiddles; // Conjugates
+    std::vector<uint32_t> bitReversal;          // FFT input permutation
+    std::vector<std::complex<double>> lineBlock; // Transposed group of x lines
+    std::vector<double> potential;              // M³ potential
+    std::vector<double> accel;                  // 3 × M³ grid accelerations
+    double origin[3] = {0.0, 0.0, 0.0};
+    double cell = 1.0;
+};
+ParticleMesh mesh;
+
+/**
+ * In-place radix-2 FFT of `batch` interleaved mesh lines (2M points each):
+ * point k of line t is data[k * stride + t]. Butterflies run across the
+ * batch innermost, so strided axes are transformed a whole contiguous row
+ * at a time instead of gathering lines. The inverse is unscaled.
+ */
+void meshFFT(std::complex<double>* data, size_t n, size_t stride, size_t batch, bool inverse) {
+    const uint32_t* reversed = mesh.bitReversal.data();
+    for (size_t i = 0; i < n; i++) {
+        size_t j = reversed[i];
+        if (i < j) {
+            std::swap_ranges(data + i * stride, data + i * stride + batch, data + j * stride);
+        }
+    }
+    const std::complex<double>* twiddles = inverse ? mesh.inverseTwiddles.data() : mesh.twiddles.data();
+    double* d = reinterpret_cast<double*>(data);
+    for (size_t len = 2; len <= n; len <<= 1) {
+        const size_t half = len / 2;
+        const size_t step = n / len;
+        for (size_t i = 0; i < n; i += len) {
+            for (size_t k = 0; k < half; k++) {
+                // Written out: std::complex operator* goes through the
+                // NaN-checking __muldc3 path
+                const double wr = twiddles[k * step].real();
+                const double wi = twiddles[k * step].imag();
+                double* a = d + 2 * (i + k) * stride;
+                double* b = d + 2 * (i + k + half) * stride;
+                for (size_t t = 0; t < 2 * batch; t += 2) {
+                    double br = b[t] * wr - b[t + 1] * wi;
+                    double bi = b[t] * wi + b[t + 1] * wr;
+                    b[t] = a[t] - br;
+                    b[t + 1] = a[t + 1] - bi;
+                    a[t] += br;
+                    a[t + 1] += bi;
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Transform the padded grid along one axis (0 = x, 1 = y, 2 = z), only
+ * for the lines whose other two indices are below limitA / limitB: lines
+ * that are still all zero (forward) or never read (inverse) are skipped.
+ * limitA is the faster-varying of the two (x for the y and z axes).
+ */
+void meshTransformAxis(int axis, size_t limitA, size_t limitB, bool inverse) {
+    const size_t p = 2 * static_cast<size_t>(mesh.size);
+    std::complex<double>* grid = mesh.grid.data();
+    
+    for (size_t b = 0; b < limitB; b++) {
+        if (axis == 0) {
+            // x lines (y < limitA, z = b) are contiguous: transpose a group
+            // of them into the scratch block so they can be batched too
+            std::complex<double>* block = mesh.lineBlock.data();
+            for (size_t a = 0; a < limitA; a += MESH_LINE_BATCH) {
+                const size_t count = std::min(MESH_LINE_BATCH, limitA - a);
+                std::complex<double>* rows = grid + (b * p + a) * p;
+                for (size_t t = 0; t < count; t++) {
+                    for (size_t k = 0; k < p; k++) block[k * count + t] = rows[t * p + k];
+                }
+                meshFFT(block, p, count, count, inverse);
+                for (size_t t = 0; t < count; t++) {
+                    for (size_t k = 0; k < p; k++) rows[t * p + k] = block[k * count + t];
+                }
+            }
+        } else if (axis == 1) {
+            // y lines of plane z = b, batched over x < limitA
+            meshFFT(grid + b * p * p, p, p, limitA, inverse);
+        } else {
+            // z lines of row y = b, batched over x < limitA
+            meshFFT(grid + b * p, p, p * p, limitA, inverse);
+        }
+    }
+}
+
+// (Re)build the size-dependent buffers and the Green's function transform
+void configureParticleMesh() {
+    const size_t m = static_cast<size_t>(meshSize);
+    const size_t p = 2 * m;
+    if (mesh.size == meshSize) return;
+    mesh.size = meshSize;
+    mesh.grid.assign(p * p * p, std::complex<double>(0.0, 0.0));
+    mesh.potential.assign(m * m * m, 0.0);
+    mesh.accel.assign(3 * m * m * m, 0.0);
+    mesh.lineBlock.resize(p * MESH_LINE_BATCH);
+    mesh.twiddles.resize(m);
+    mesh.inverseTwiddles.resize(m);
+    for (size_t k = 0; k < m; k++) {
+        double angle = -2.0 * M_PI * k / p;
+        mesh.twiddles[k] = std::complex<double>(cos(angle), sin(angle));
+        mesh.inverseTwiddles[k] = std::conj(mesh.twiddles[k]);
+    }
+    mesh.bitReversal.resize(p);
+    for (size_t i = 0, j = 0; i < p; i++) {
+        mesh.bitReversal[i] = static_cast<uint32_t>(j);
+        size_t bit = p >> 1;
+        for (; j & bit; bit >>= 1) {
+            j ^= bit;
+        }
+        j ^= bit;
+    }
+    
+    // 1/r in cell units with wrapped (padded) distances; r = 0 takes the
+    // value at one cell, i.e. cell-scale softening
+    for (size_t z = 0; z < p; z++) {
+        double dz = static_cast<double>(std::min(z, p - z));
+        for (size_t y = 0; y < p; y++) {
+            double dy = static_cast<double>(std::min(y, p - y));
+            for (size_t x = 0; x < p; x++) {
+                double dx = static_cast<double>(std::min(x, p - x));
+                double r = sqrt(dx * dx + dy * dy + dz * dz);
+                mesh.grid[(z * p + y) * p + x] = std::complex<double>(r > 0.0 ? 1.0 / r : 1.0, 0.0);
+            }
+        }
+    }
+    for (int axis = 0; axis < 3; axis++) {
+        meshTransformAxis(axis, p, p, false);
+    }
+    // The kernel is real and even, so its transform is real; fold in the
+    // 1 / (2M)³ normalization of the inverse transform
+    const double norm = 1.0 / static_cast<double>(p * p * p);
+    mesh.greenHat.resize(p * p * p);
+    for (size_t i = 0; i < mesh.grid.size(); i++) {
+        mesh.greenHat[i] = mesh.grid[i].real() * norm;
+    }
+}
+
+// Cell index and CIC fraction of a position along one axis
+inline void meshCoordinate(double position, int axis, int& index, double& fraction) {
+    double u = (position - mesh.origin[axis]) / mesh.cell;
+    index = static_cast<int>(floor(u));
+    fraction = u - index;
+}
+
+/**
+ * Deposit, solve and (optionally) difference the potential on the grid.
+ * The grid is refitted to the current bounding cube on every solve, with
+ * one cell of margin so CIC's upper neighbour stays inside.
+ */
+void solveParticleMesh(bool withAccelerations) {
+    configureParticleMesh();
+    const size_t m = static_cast<size_t>(mesh.size);
+    const size_t p = 2 * m;
+    
+    double lo[3] = {INFINITY, INFINITY, INFINITY};
+    double hi[3] = {-INFINITY, -INFINITY, -INFINITY};
+    for (const auto& body : bodies) {
+        const double pos[3] = {body.x, body.y, body.z};
+        for (int d = 0; d < 3; d++) {
+            lo[d] = std::min(lo[d], pos[d]);
+            hi[d] = std::max(hi[d], pos[d]);
+        }
+    }
+    double extent = std::max(hi[0] - lo[0], std::max(hi[1] - lo[1], hi[2] - lo[2]));
+    if (!(extent > 0.0)) extent = 1.0;
+    mesh.cell = extent / (m - 3.0);
+    for (int d = 0; d < 3; d++) {
+        mesh.origin[d] = 0.5 * (lo[d] + hi[d]) - 0.5 * (m - 1.0) * mesh.cell;
+    }
+    
+    // Cloud-in-cell mass deposit into the [0, M)³ corner of the padded grid
+    std::fill(mesh.grid.begin(), mesh.grid.end(), std::complex<double>(0.0, 0.0));
+    std::complex<double>* grid = mesh.grid.data();
+    for (const auto& body : bodies) {
+        int ix, iy, iz;
+        double fx, fy, fz;
+        meshCoordinate(body.x, 0, ix, fx);
+        meshCoordinate(body.y, 1, iy, fy);
+        meshCoordinate(body.z, 2, iz, fz);
+        for (int c = 0; c < 8; c++) {
+            int ox = c & 1, oy = (c >> 1) & 1, oz = c >> 2;
+            double w = (ox ? fx : 1.0 - fx) * (oy ? fy : 1.0 - fy) * (oz ? fz : 1.0 - fz);
+            grid[((iz + oz) * p + (iy + oy)) * p + (ix + ox)] += body.mass * w;
+        }
+    }
+    
+    // Convolve with the Green's function: forward transform of the
+    // non-zero octant, multiply, inverse transform of what is read back
+    meshTransformAxis(0, m, m, false);
+    meshTransformAxis(1, p, m, false);
+    meshTransformAxis(2, p, p, false);
+    for (size_t i = 0; i < mesh.grid.size(); i++) {
+        grid[i] *= mesh.greenHat[i];
+    }
+    meshTransformAxis(2, p, p, true);
+    meshTransformAxis(1, p, m, true);
+    meshTransformAxis(0, m, m, true);
+    
+    const double scale = -G / mesh.cell;
+    for (size_t z = 0; z < m; z++) {
+        for (size_t y = 0; y < m; y++) {
+            for (size_t x = 0; x < m; x++) {
+                mesh.potential[(z * m + y) * m + x] = scale * grid[(z * p + y) * p + x].real();
+            }
+        }
+    }
+    if (!withAccelerations) return;
+    
+    // a = -∇φ: central differences, one-sided on the faces
+    const double* phi = mesh.potential.data();
+    const size_t strides[3] = {1, m, m * m};
+    for (size_t z = 0; z < m; z++) {
+        for (size_t y = 0; y < m; y++) {
+            for (size_t x = 0; x < m; x++) {
+                const size_t index = (z * m + y) * m + x;
+                const size_t coords[3] = {x, y, z};
+                for (int d = 0; d < 3; d++) {
+                    size_t lower = coords[d] > 0 ? index - strides[d] : index;
+                    size_t upper = coords[d] + 1 < m ? index + strides[d] : index;
+                    double span = static_cast<double>((upper - lower) / strides[d]) * mesh.cell;
+                    mesh.accel[3 * index + d] = -(phi[upper] - phi[lower]) / span;
+                }
+            }
+        }
+    }
+}
+
+// CIC interpolation of a grid quantity with `components` values per node
+inline void meshInterpolate(const Body& body, const double* field, int components, double* out) {
+    const size_t m = static_cast<size_t>(mesh.size);
+    int ix, iy, iz;
+    double fx, fy, fz;
+    meshCoordinate(body.x, 0, ix, fx);
+    meshCoordinate(body.y, 1, iy, fy);
+    meshCoordinate(body.z, 2, iz, fz);
+    for (int k = 0; k < components; k++) out[k] = 0.0;
+    for (int c = 0; c < 8; c++) {
+        int ox = c & 1, oy = (c >> 1) & 1, oz = c >> 2;
+        double w = (ox ? fx : 1.0 - fx) * (oy ? fy : 1.0 - fy) * (oz ? fz : 1.0 - fz);
+        const double* node = field + components * (((iz + oz) * m + (iy + oy)) * m + (ix + ox));
+        for (int k = 0; k < components; k++) out[k] += w * node[k];
+    }
+}
+
+void calculateForcesParticleMesh() {
+    solveParticleMesh(true);
+    for (auto& body : bodies) {
+        double a[3];
+        meshInterpolate(body, mesh.accel.data(), 3, a);
+        body.ax = a[0];
+        body.ay = a[1];
+        body.az = a[2];
+    }
+}
+
+// PE = ½ Σ m φ(x) on the mesh, for diagnostics of particle-mesh runs
+// (includes the cell-scale self-energy, so compare drifts, not values)
+double particleMeshPotentialEnergy() {
+    solveParticleMesh(false);
+    double energy = 0.0;
+    for (const auto& body : bodies) {
+        double phi;
+        meshInterpolate(body, mesh.potential.data(), 1, &phi);
+        energy += 0.5 * body.mass * phi;
+    }
+    return energy;
+}
+
+/**
+ * FORCE TERMS: optional physics as separate passes after the gravity kernel
+ * 
+ * The kernels above do (softened) Newtonian gravity only, so their pair
+ * loop stays branch-free. Everything else is a ForceTerm, which
+ * applyForceTerms() runs after the kernel in forceTerms[] order:
+ *   - near-pair terms (tidal dissipation, GW radiation) only act inside a
+ *     cutoff, so they share one candidate list of the pairs closer than
+ *     the largest active cutoff (a squared-distance sweep, no sqrt for
+ *     pairs outside it)
+ *   - all-pair terms (1PN) and per-body terms (drag) loop on their own
+ * Each pass hoists its constants (G⁴/c⁵ and the like) out of the loop.
+ * selectKernels() collects the enabled terms, so a disabled term costs
+ * nothing and with none enabled applyForceTerms() returns immediately.
+ * 
+ * The damping terms scale velocities. Accelerations do not depend on
+ * velocities, so damping after the accumulation matches the former
+ * in-loop version.
+ */
+enum ForceTermScope {
+    TERM_NEAR_PAIRS,   // Receives the candidate pairs within range()
+    TERM_ALL_PAIRS,    // Loops over every pair itself
+    TERM_PER_BODY      // Independent of the other bodies
+};
+
+struct ForceTerm {
+    const char* name;
+    ForceTermScope scope;
+    bool (*enabled)();
+    double (*range)();  // TERM_NEAR_PAIRS: largest separation that can interact
+    void (*apply)(const ForcePair* pairs, size_t count);
+};
+
+// Tidal dissipation (quadrupole approximation): for pairs within 5 radii of
+// both bodies, tidal acceleration ~ 0.01 G M R / r³ damps each velocity
+bool tidalTermEnabled() { return enableTidalForces; }
+
+double tidalTermRange() {
+    double radius = 0.0;
+    for (const auto& body : bodies) radius = std::max(radius, body.radius);
+    return 5.0 * radius;
+}
+
+void applyTidalTerm(const ForcePair* pairs, size_t count) {
+    Body* b = bodies.data();
+    const double damping = 0.01 * G * dt * 0.001;   // tidal factor × G × damping rate
+    for (size_t k = 0; k < count; k++) {
+        const ForcePair& pair = pairs[k];
+        Body& bi = b[pair.i];
+        Body& bj = b[pair.j];
+        if (pair.dist >= bi.radius * 5 || pair.dist >= bj.radius * 5) continue;
+        double invDist3 = 1.0 / (pair.dist * pair.dist * pair.dist);
+        double factorI = 1.0 - damping * bj.mass * bi.radius * invDist3;
+        double factorJ = 1.0 - damping * bi.mass * bj.radius * invDist3;
+        bi.vx *= factorI;
+        bi.vy *= factorI;
+        bi.vz *= factorI;
+        bj.vx *= factorJ;
+        bj.vy *= factorJ;
+        bj.vz *= factorJ;
+    }
+}
+
+// Gravitational-wave energy loss for pairs closer than 100 units:
+// dE/dt = -(32/5) G⁴/c⁵ (m1 m2)² (m1 + m2) / r⁵, applied as velocity damping
+const double GW_RANGE = 100.0;
+
+bool gravitationalWaveTermEnabled() { return enableGravitationalWaves; }
+
+double gravitationalWaveTermRange() { return GW_RANGE; }
+
+void applyGravitationalWaveTerm(const ForcePair* pairs, size_t count) {
+    Body* b = bodies.data();
+    const double c = speedOfLight;
+    const double G2 = G * G;
+    const double gwFactor = (32.0 / 5.0) * G2 * G2 / (c * c * c * c * c);
+    const double damping = gwFactor * dt * 0.0001;
+    for (size_t k = 0; k < count; k++) {
+        const ForcePair& pair = pairs[k];
+        if (pair.dist >= GW_RANGE) continue;
+        Body& bi = b[pair.i];
+        Body& bj = b[pair.j];
+        double m1m2 = bi.mass * bj.mass;
+        double distSq = pair.dist * pair.dist;
+        double factor = 1.0 - damping * m1m2 * m1m2 * (bi.mass + bj.mass) / (distSq * distSq * pair.dist);
+        bi.vx *= factor;
+        bi.vy *= factor;
+        bi.vz *= factor;
+        bj.vx *= factor;
+        bj.vy *= factor;
+        bj.vz *= factor;
+    }
+}
+
+// First post-Newtonian correction (relative two-body motion, test-mass
+// limit, harmonic coordinates), shared by mass ratio so momentum is kept:
+// a_1PN = G M / (c² r²) [(4 G M / r - v²) n + 4 (n·v) v],  r = x_i - x_j
+bool postNewtonianTermEnabled() { return enablePostNewtonian; }
+
+void applyPostNewtonianTerm(const ForcePair*, size_t) {
+    Body* b = bodies.data();
+    const size_t n = bodies.size();
+    const double invCSq = 1.0 / (speedOfLight * speedOfLight);
+    for (size_t i = 0; i < n; i++) {
+        for (size_t j = i + 1; j < n; j++) {
+            double dx = b[i].x - b[j].x;
+            double dy = b[i].y - b[j].y;
+            double dz = b[i].z - b[j].z;
+            double distSq = dx * dx + dy * dy + dz * dz;
+            if (distSq <= 0.0) continue;
+            double dist = sqrt(distSq);
+            double vx = b[i].vx - b[j].vx;
+            double vy = b[i].vy - b[j].vy;
+            double vz = b[i].vz - b[j].vz;
+            double totalMass = b[i].mass + b[j].mass;
+            double gm = G * totalMass;
+            double nv = (dx * vx + dy * vy + dz * vz) / dist;
+            double radial = (4.0 * gm / dist - (vx * vx + vy * vy + vz * vz)) / dist;
+            double scale = gm * invCSq / distSq;
+            double ax = scale * (radial * dx + 4.0 * nv * vx);
+            double ay = scale * (radial * dy + 4.0 * nv * vy);
+            double az = scale * (radial * dz + 4.0 * nv * vz);
+            double shareI = b[j].mass / totalMass;
+            double shareJ = b[i].mass / totalMass;
+            b[i].ax += shareI * ax;
+            b[i].ay += shareI * ay;
+            b[i].az += shareI * az;
+            b[j].ax -= shareJ * ax;
+            b[j].ay -= shareJ * ay;
+            b[j].az -= shareJ * az;
+        }
+    }
+}
+
+// Linear drag against a resting medium: a -= k v
+bool dragTermEnabled() { return dragCoefficient > 0.0; }
+
+void applyDragTerm(const ForcePair*, size_t) {
+    const double k = dragCoefficient;
+    for (auto& body : bodies) {
+        body.ax -= k * body.vx;
+        body.ay -= k * body.vy;
+        body.az -= k * body.vz;
+    }
+}
+
+const ForceTerm forceTerms[] = {
+    { "tidal",               TERM_NEAR_PAIRS, tidalTermEnabled,             tidalTermRange,             applyTidalTerm },
+    { "gravitational-waves", TERM_NEAR_PAIRS, gravitationalWaveTermEnabled, gravitationalWaveTermRange, applyGravitationalWaveTerm },
+    { "post-newtonian",      TERM_ALL_PAIRS,  postNewtonianTermEnabled,     nullptr,                    applyPostNewtonianTerm },
+    { "drag",                TERM_PER_BODY,   dragTermEnabled,              nullptr,                    applyDragTerm }
+};
+const size_t FORCE_TERM_COUNT = sizeof(forceTerms) / sizeof(forceTerms[0]);
+
+// Enabled terms, collected by selectForceTerms() whenever a toggle changes
+const ForceTerm* activeForceTerms[FORCE_TERM_COUNT];
+size_t activeForceTermCount = 0;
+bool nearPairTermsActive = false;
+
+void selectForceTerms() {
+    activeForceTermCount = 0;
+    nearPairTermsActive = false;
+    for (const ForceTerm& term : forceTerms) {
+        if (term.enabled()) {
+            activeForceTerms[activeForceTermCount++] = &term;
+            nearPairTermsActive = nearPairTermsActive || term.scope == TERM_NEAR_PAIRS;
+        }
+    }
+}
+
+// Candidate list: every pair closer than range, in (i, j) order
+void buildForcePairs(double range) {
+    std::vector<ForcePair>& pairs = stepScratch.forcePairs;
+    pairs.clear();
+    const Body* b = bodies.data();
+    const size_t n = bodies.size();
+    const double rangeSq = range * range;
+    for (size_t i = 0; i < n; i++) {
+        for (size_t j = i + 1; j < n; j++) {
+            double dx = b[j].x - b[i].x;
+            double dy = b[j].y - b[i].y;
+            double dz = b[j].z - b[i].z;
+            double distSq = dx * dx + dy * dy + dz * dz;
+            if (distSq < rangeSq) {
+                pairs.push_back({static_cast<uint32_t>(i), static_cast<uint32_t>(j), sqrt(distSq)});
+            }
+        }
+    }
+}
+
+void applyForceTerms() {
+    if (activeForceTermCount == 0) return;
+    if (nearPairTermsActive) {
+        double range = 0.0;
+        for (size_t t = 0; t < activeForceTermCount; t++) {
+            if (activeForceTerms[t]->scope == TERM_NEAR_PAIRS) {
+                range = std::max(range, activeForceTerms[t]->range());
+            }
+        }
+        buildForcePairs(range);
+    }
+    const std::vector<ForcePair>& pairs = stepScratch.forcePairs;
+    for (size_t t = 0; t < activeForceTermCount; t++) {
+        const ForceTerm& term = *activeForceTerms[t];
+        if (term.scope == TERM_NEAR_PAIRS) {
+            term.apply(pairs.data(), pairs.size());
+        } else {
+            term.apply(nullptr, 0);
+        }
+    }
+}
+
+ForceKernel activeForceKernel = forceKernelTable[0][0];
+
+// Instantiation currently selected; kernelBodyCount is re-checked on every
+// force evaluation so merges, removals and presets re-dispatch lazily
+size_t kernelBodyCount = static_cast<size_t>(-1);
+unsigned kernelFeatures = 0;
+
+void selectEvaluateKernel();  // RK4/RKF45 counterpart, defined with evaluate()
+
+unsigned currentForceFeatures() {
+    unsigned features = 0;
+    if (softeningLength > 0.0) features |= FORCE_SOFTENING;
+    return features;
+}
+
+/**
+ * Dispatcher: pick the kernel instantiations matching the current body
+ * count and feature toggles. Called by the setters when settings change.
+ */
+void selectKernels() {
+    kernelBodyCount = bodies.size();
+    kernelFeatures = currentForceFeatures();
+    size_t row = kernelBodyCount <= static_cast<size_t>(MAX_SPECIALIZED_BODIES) ? kernelBodyCount : 0;
+    activeForceKernel = forceKernelTable[row][kernelFeatures];
+    if (mixedPrecision) {
+        activeForceKernel = (kernelFeatures & FORCE_SOFTENING) != 0
+            ? &calculateForcesMixedKernel<true>
+            : &calculateForcesMixedKernel<false>;
+    }
+    if (particleMeshEnabled) {
+        activeForceKernel = &calculateForcesParticleMesh;
+    }
+    selectEvaluateKernel();
+    selectForceTerms();
+    stepScratch.reserve(kernelBodyCount);
+}
+
+void calculateForces() {
+    PROFILE_PHASE(PHASE_FORCES);
+    if (bodies.size() != kernelBodyCount) {
+        selectKernels();
+    }
+    PROFILE_COUNT(pairInteractions, 0.5 * kernelBodyCount * (kernelBodyCount - 1.0));
+    activeForceKernel();
+    applyForceTerms();
+}
+
+/**
+ * PHYSICS: Collision Detection and Response (3D)
+ * 
+ * Realistic collision mechanics:
+ * 1. Conservation of linear momentum: m1*v1 + m2*v2 = (m1+m2)*v_final
+ * 2. Conservation of angular momentum: L1 + L2 = L_final
+ * 3. Energy dissipation through coefficient of restitution
  * 4. Merging for catastrophic collisions (high velocity/mass ratio)
  * 
  * Elastic collision formula:
  * v1' = ((m1 - m2) * v1 + 2 * m2 * v2) / (m1 + m2)
  * v2' = ((m2 - m1) * v2 + 2 * m1 * v1) / (m1 + m2)
+ * 
+ * Continuous mode (continuousCollisions) also sweeps each pair's spheres
+ * along the step's Hermite-interpolated motion and solves for the first
+ * time of impact, so a fast body cannot pass through another between
+ * steps. The pair is rewound to that moment, merged or bounced there, and
+ * carried ballistically to the end of the step.
  */
+double sweptContactFraction(size_t i, size_t j, double contactDistance);
+void rewindToContact(size_t i, size_t j, double s);
+extern double stepSize;
+TaskCosts collisionCosts;
+
+/**
+ * First row i with a contact against any j > i, or the body count if
+ * there is none. Read-only, so large scenes scan the (triangular) pair
+ * loop in parallel and resolve serially only from the first contact on,
+ * in exactly the order the serial loop would have.
+ */
+size_t firstContactRow() {
+    const size_t n = bodies.size();
+    if (n < PARALLEL_MIN_BODIES || activeWorkers() == 1) return 0;
+    
+    std::atomic<size_t> first{n};
+    parallelFor(collisionCosts, n, 16, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end && i < first.load(std::memory_order_relaxed); i++) {
+            for (size_t j = i + 1; j < n; j++) {
+                double dx = bodies[j].x - bodies[i].x;
+                double dy = bodies[j].y - bodies[i].y;
+                double dz = bodies[j].z - bodies[i].z;
+                double minDist = bodies[i].radius + bodies[j].radius;
+                if (sqrt(dx * dx + dy * dy + dz * dz) < minDist ||
+                    (continuousCollisions && sweptContactFraction(i, j, minDist) >= 0.0)) {
+                    size_t seen = first.load();
+                    while (i < seen && !first.compare_exchange_weak(seen, i)) {}
+                    return;
+                }
+            }
+        }
+    });
+    return first.load();
+}
+
 void handleCollisions() {
     if (!enableCollisions) return;
+    PROFILE_PHASE(PHASE_COLLISIONS);
     
-    std::vector<size_t> bodiesToRemove;
+    std::vector<size_t>& bodiesToRemove = stepScratch.removals;
+    std::vector<char>& removed = stepScratch.removed;
+    bodiesToRemove.clear();
+    removed.assign(bodies.size(), 0);
     
-    for (size_t i = 0; i < bodies.size(); i++) {
+    for (size_t i = firstContactRow(); i < bodies.size(); i++) {
+        if (removed[i]) continue;   // Its mass already went to a survivor
         for (size_t j = i + 1; j < bodies.size(); j++) {
+            if (removed[j]) continue;
             double dx = bodies[j].x - bodies[i].x;
             double dy = bodies[j].y - bodies[i].y;
             double dz = bodies[j].z - bodies[i].z;
             double dist = sqrt(dx * dx + dy * dy + dz * dz);
             double minDist = bodies[i].radius + bodies[j].radius;
             
-            if (dist < minDist) {
+            double contact = continuousCollisions ? sweptContactFraction(i, j, minDist) : -1.0;
+            if (contact >= 0.0) {
+                rewindToContact(i, j, contact);
+                dx = bodies[j].x - bodies[i].x;
+                dy = bodies[j].y - bodies[i].y;
+                dz = bodies[j].z - bodies[i].z;
+                dist = sqrt(dx * dx + dy * dy + dz * dz);
+            }
+            
+            if (dist < minDist || contact >= 0.0) {
                 // Collision detected!
+                PROFILE_COUNT(collisions, 1.0);
                 double m1 = bodies[i].mass;
                 double m2 = bodies[j].mass;
                 double totalMass = m1 + m2;
@@ -757,6 +2345,8 @@ void handleCollisions() {
                     
                     // Mark smaller body for removal
                     bodiesToRemove.push_back(j);
+                    removed[j] = 1;
+                    PROFILE_COUNT(merges, 1.0);
                 } else {
                     // ELASTIC/INELASTIC BOUNCE
                     // Normal vector
@@ -795,14 +2385,25 @@ void handleCollisions() {
                         bodies[j].z += nz * sep2;
                     }
                 }
+                
+                // Continuous: carry the resolved pair from contact to step end
+                if (contact >= 0.0) {
+                    double remaining = (1.0 - contact) * stepSize;
+                    for (size_t k : { i, j }) {
+                        bodies[k].x += bodies[k].vx * remaining;
+                        bodies[k].y += bodies[k].vy * remaining;
+                        bodies[k].z += bodies[k].vz * remaining;
+                    }
+                }
             }
         }
     }
     
-    // Remove merged bodies (in reverse order to maintain indices)
+    // Remove merged bodies, highest slot first: each removal only moves the
+    // last body, which is never one still waiting to be removed
     std::sort(bodiesToRemove.begin(), bodiesToRemove.end(), std::greater<size_t>());
     for (size_t idx : bodiesToRemove) {
-        bodies.erase(bodies.begin() + idx);
+        eraseBody(idx);
     }
 }
 
@@ -894,7 +2495,13 @@ struct Derivative {
     double dx, dy, dz, dvx, dvy, dvz;
 };
 
-Derivative evaluate(const State& initial, double dt, const Derivative& d, std::vector<Body>& tempBodies, size_t bodyIndex) {
+/**
+ * Acceleration on one body at a trial state, specialized like
+ * calculateForcesKernel on body count and softening.
+ */
+template <int N, bool Softened>
+Derivative evaluateKernel(const State& initial, double dt, const Derivative& d, std::vector<Body>& tempBodies, size_t bodyIndex) {
+    const size_t n = N > 0 ? static_cast<size_t>(N) : tempBodies.size();
     State state;
     state.x = initial.x + d.dx * dt;
     state.y = initial.y + d.dy * dt;
@@ -914,21 +2521,24 @@ Derivative evaluate(const State& initial, double dt, const Derivative& d, std::v
     output.dz = state.vz;
     
     // Calculate acceleration at this state
+    const Body* b = tempBodies.data();
+    const double softeningSq = softeningLength * softeningLength;
     double ax = 0, ay = 0, az = 0;
-    for (size_t j = 0; j < tempBodies.size(); j++) {
+    for (size_t j = 0; j < n; j++) {
         if (bodyIndex != j) {
-            double dx = tempBodies[j].x - state.x;
-            double dy = tempBodies[j].y - state.y;
-            double dz = tempBodies[j].z - state.z;
+            double dx = b[j].x - state.x;
+            double dy = b[j].y - state.y;
+            double dz = b[j].z - state.z;
             double distSq = dx * dx + dy * dy + dz * dz;
-            double dist = sqrt(distSq);
-            dist = fmax(dist, 1.0);
             
             // Optional softening
-            double softenedDistSq = distSq + softeningLength * softeningLength;
+            double softenedDistSq = distSq;
+            if constexpr (Softened) {
+                softenedDistSq = distSq + softeningSq;
+            }
             double softenedDist = sqrt(softenedDistSq);
             
-            double force = G * tempBodies[j].mass / softenedDistSq;
+            double force = G * b[j].mass / softenedDistSq;
             ax += force * dx / softenedDist;
             ay += force * dy / softenedDist;
             az += force * dz / softenedDist;
@@ -941,33 +2551,65 @@ Derivative evaluate(const State& initial, double dt, const Derivative& d, std::v
     return output;
 }
 
+typedef Derivative (*EvaluateKernel)(const State&, double, const Derivative&, std::vector<Body>&, size_t);
+
+// Indexed by [body count][softened]; rows 0 and 1 use the generic kernel
+const EvaluateKernel evaluateKernelTable[MAX_SPECIALIZED_BODIES + 1][2] = {
+    { &evaluateKernel<0, false>, &evaluateKernel<0, true> },
+    { &evaluateKernel<0, false>, &evaluateKernel<0, true> },
+    { &evaluateKernel<2, false>, &evaluateKernel<2, true> },
+    { &evaluateKernel<3, false>, &evaluateKernel<3, true> },
+    { &evaluateKernel<4, false>, &evaluateKernel<4, true> }
+};
+
+EvaluateKernel activeEvaluateKernel = evaluateKernelTable[0][0];
+
+void selectEvaluateKernel() {
+    size_t row = kernelBodyCount <= static_cast<size_t>(MAX_SPECIALIZED_BODIES) ? kernelBodyCount : 0;
+    activeEvaluateKernel = evaluateKernelTable[row][(kernelFeatures & FORCE_SOFTENING) != 0];
+}
+
+EvaluateKernel currentEvaluateKernel() {
+    if (bodies.size() != kernelBodyCount) {
+        selectKernels();
+    }
+    return activeEvaluateKernel;
+}
+
 void updateBodiesRK4() {
     double effectiveDt = dt * timeScale;
-    std::vector<Body> tempBodies = bodies;
-    
-    for (size_t i = 0; i < bodies.size(); i++) {
-        State state = {bodies[i].x, bodies[i].y, bodies[i].z, 
-                       bodies[i].vx, bodies[i].vy, bodies[i].vz};
+    const EvaluateKernel evaluate = currentEvaluateKernel();
+    std::vector<Body>& tempBodies = stepScratch.stageBodies;
+    tempBodies.assign(bodies.begin(), bodies.end());
+    
+    // RK stage evaluations are the force evaluation for this integrator
+    {
+        PROFILE_PHASE(PHASE_FORCES);
+        PROFILE_COUNT(pairInteractions, 4.0 * bodies.size() * (bodies.size() - 1.0));
+        for (size_t i = 0; i < bodies.size(); i++) {
+            State state = {bodies[i].x, bodies[i].y, bodies[i].z, 
+                           bodies[i].vx, bodies[i].vy, bodies[i].vz};
         
-        Derivative k1 = evaluate(state, 0.0, {0,0,0,0,0,0}, tempBodies, i);
-        Derivative k2 = evaluate(state, effectiveDt*0.5, k1, tempBodies, i);
-        Derivative k3 = evaluate(state, effectiveDt*0.5, k2, tempBodies, i);
-        Derivative k4 = evaluate(state, effectiveDt, k3, tempBodies, i);
+            Derivative k1 = evaluate(state, 0.0, {0,0,0,0,0,0}, tempBodies, i);
+            Derivative k2 = evaluate(state, effectiveDt*0.5, k1, tempBodies, i);
+            Derivative k3 = evaluate(state, effectiveDt*0.5, k2, tempBodies, i);
+            Derivative k4 = evaluate(state, effectiveDt, k3, tempBodies, i);
         
-        // Combine derivatives
-        double dxdt = (k1.dx + 2.0*k2.dx + 2.0*k3.dx + k4.dx) / 6.0;
-        double dydt = (k1.dy + 2.0*k2.dy + 2.0*k3.dy + k4.dy) / 6.0;
-        double dzdt = (k1.dz + 2.0*k2.dz + 2.0*k3.dz + k4.dz) / 6.0;
-        double dvxdt = (k1.dvx + 2.0*k2.dvx + 2.0*k3.dvx + k4.dvx) / 6.0;
-        double dvydt = (k1.dvy + 2.0*k2.dvy + 2.0*k3.dvy + k4.dvy) / 6.0;
-        double dvzdt = (k1.dvz + 2.0*k2.dvz + 2.0*k3.dvz + k4.dvz) / 6.0;
+            // Combine derivatives
+            double dxdt = (k1.dx + 2.0*k2.dx + 2.0*k3.dx + k4.dx) / 6.0;
+            double dydt = (k1.dy + 2.0*k2.dy + 2.0*k3.dy + k4.dy) / 6.0;
+            double dzdt = (k1.dz + 2.0*k2.dz + 2.0*k3.dz + k4.dz) / 6.0;
+            double dvxdt = (k1.dvx + 2.0*k2.dvx + 2.0*k3.dvx + k4.dvx) / 6.0;
+            double dvydt = (k1.dvy + 2.0*k2.dvy + 2.0*k3.dvy + k4.dvy) / 6.0;
+            double dvzdt = (k1.dvz + 2.0*k2.dvz + 2.0*k3.dvz + k4.dvz) / 6.0;
         
-        bodies[i].x += dxdt * effectiveDt;
-        bodies[i].y += dydt * effectiveDt;
-        bodies[i].z += dzdt * effectiveDt;
-        bodies[i].vx += dvxdt * effectiveDt;
-        bodies[i].vy += dvydt * effectiveDt;
-        bodies[i].vz += dvzdt * effectiveDt;
+            bodies[i].x += dxdt * effectiveDt;
+            bodies[i].y += dydt * effectiveDt;
+            bodies[i].z += dzdt * effectiveDt;
+            bodies[i].vx += dvxdt * effectiveDt;
+            bodies[i].vy += dvydt * effectiveDt;
+            bodies[i].vz += dvzdt * effectiveDt;
+        }
     }
     
     handleCollisions();
@@ -982,66 +2624,281 @@ void updateBodiesRK4() {
  */
 void updateBodiesRKF45() {
     double effectiveDt = dt * timeScale;
-    std::vector<Body> tempBodies = bodies;
-    std::vector<Body> nextBodies = bodies;
+    const EvaluateKernel evaluate = currentEvaluateKernel();
+    std::vector<Body>& tempBodies = stepScratch.stageBodies;
+    std::vector<Body>& nextBodies = stepScratch.nextBodies;
+    tempBodies.assign(bodies.begin(), bodies.end());
+    nextBodies.assign(bodies.begin(), bodies.end());
     
     // RKF45 Butcher tableau coefficients
     const double a2 = 1.0/4.0, a3 = 3.0/8.0, a4 = 12.0/13.0, a5 = 1.0, a6 = 1.0/2.0;
     
     // For each body, perform RKF45 integration
-    for (size_t i = 0; i < bodies.size(); i++) {
-        State state = {bodies[i].x, bodies[i].y, bodies[i].z,
-                       bodies[i].vx, bodies[i].vy, bodies[i].vz};
+    // RK stage evaluations are the force evaluation for this integrator
+    {
+        PROFILE_PHASE(PHASE_FORCES);
+        PROFILE_COUNT(pairInteractions, 6.0 * bodies.size() * (bodies.size() - 1.0));
+        for (size_t i = 0; i < bodies.size(); i++) {
+            State state = {bodies[i].x, bodies[i].y, bodies[i].z,
+                           bodies[i].vx, bodies[i].vy, bodies[i].vz};
         
-        // Calculate k1 through k6 (Fehlberg coefficients)
-        Derivative k1 = evaluate(state, 0.0, {0,0,0,0,0,0}, tempBodies, i);
-        Derivative k2 = evaluate(state, effectiveDt * a2, k1, tempBodies, i);
-        Derivative k3 = evaluate(state, effectiveDt * a3, k2, tempBodies, i);
-        Derivative k4 = evaluate(state, effectiveDt * a4, k3, tempBodies, i);
-        Derivative k5 = evaluate(state, effectiveDt * a5, k4, tempBodies, i);
-        Derivative k6 = evaluate(state, effectiveDt * a6, k5, tempBodies, i);
+            // Calculate k1 through k6 (Fehlberg coefficients)
+            Derivative k1 = evaluate(state, 0.0, {0,0,0,0,0,0}, tempBodies, i);
+            Derivative k2 = evaluate(state, effectiveDt * a2, k1, tempBodies, i);
+            Derivative k3 = evaluate(state, effectiveDt * a3, k2, tempBodies, i);
+            Derivative k4 = evaluate(state, effectiveDt * a4, k3, tempBodies, i);
+            Derivative k5 = evaluate(state, effectiveDt * a5, k4, tempBodies, i);
+            Derivative k6 = evaluate(state, effectiveDt * a6, k5, tempBodies, i);
         
-        // 4th order solution
-        double dx4 = (25.0/216.0*k1.dx + 1408.0/2565.0*k3.dx + 2197.0/4104.0*k4.dx - 1.0/5.0*k5.dx) * effectiveDt;
-        double dy4 = (25.0/216.0*k1.dy + 1408.0/2565.0*k3.dy + 2197.0/4104.0*k4.dy - 1.0/5.0*k5.dy) * effectiveDt;
-        double dz4 = (25.0/216.0*k1.dz + 1408.0/2565.0*k3.dz + 2197.0/4104.0*k4.dz - 1.0/5.0*k5.dz) * effectiveDt;
+            // 4th order solution
+            double dx4 = (25.0/216.0*k1.dx + 1408.0/2565.0*k3.dx + 2197.0/4104.0*k4.dx - 1.0/5.0*k5.dx) * effectiveDt;
+            double dy4 = (25.0/216.0*k1.dy + 1408.0/2565.0*k3.dy + 2197.0/4104.0*k4.dy - 1.0/5.0*k5.dy) * effectiveDt;
+            double dz4 = (25.0/216.0*k1.dz + 1408.0/2565.0*k3.dz + 2197.0/4104.0*k4.dz - 1.0/5.0*k5.dz) * effectiveDt;
         
-        // 5th order solution
-        double dx5 = (16.0/135.0*k1.dx + 6656.0/12825.0*k3.dx + 28561.0/56430.0*k4.dx - 9.0/50.0*k5.dx + 2.0/55.0*k6.dx) * effectiveDt;
-        double dy5 = (16.0/135.0*k1.dy + 6656.0/12825.0*k3.dy + 28561.0/56430.0*k4.dy - 9.0/50.0*k5.dy + 2.0/55.0*k6.dy) * effectiveDt;
-        double dz5 = (16.0/135.0*k1.dz + 6656.0/12825.0*k3.dz + 28561.0/56430.0*k4.dz - 9.0/50.0*k5.dz + 2.0/55.0*k6.dz) * effectiveDt;
+            // 5th order solution
+            double dx5 = (16.0/135.0*k1.dx + 6656.0/12825.0*k3.dx + 28561.0/56430.0*k4.dx - 9.0/50.0*k5.dx + 2.0/55.0*k6.dx) * effectiveDt;
+            double dy5 = (16.0/135.0*k1.dy + 6656.0/12825.0*k3.dy + 28561.0/56430.0*k4.dy - 9.0/50.0*k5.dy + 2.0/55.0*k6.dy) * effectiveDt;
+            double dz5 = (16.0/135.0*k1.dz + 6656.0/12825.0*k3.dz + 28561.0/56430.0*k4.dz - 9.0/50.0*k5.dz + 2.0/55.0*k6.dz) * effectiveDt;
         
-        // Error estimate
-        double error = sqrt((dx5-dx4)*(dx5-dx4) + (dy5-dy4)*(dy5-dy4) + (dz5-dz4)*(dz5-dz4));
+            // Error estimate
+            double error = sqrt((dx5-dx4)*(dx5-dx4) + (dy5-dy4)*(dy5-dy4) + (dz5-dz4)*(dz5-dz4));
         
-        // Use 5th order solution (more accurate)
-        nextBodies[i].x = bodies[i].x + dx5;
-        nextBodies[i].y = bodies[i].y + dy5;
-        nextBodies[i].z = bodies[i].z + dz5;
+            // Use 5th order solution (more accurate)
+            nextBodies[i].x = bodies[i].x + dx5;
+            nextBodies[i].y = bodies[i].y + dy5;
+            nextBodies[i].z = bodies[i].z + dz5;
         
-        // Update velocities similarly
-        double dvx4 = (25.0/216.0*k1.dvx + 1408.0/2565.0*k3.dvx + 2197.0/4104.0*k4.dvx - 1.0/5.0*k5.dvx) * effectiveDt;
-        double dvy4 = (25.0/216.0*k1.dvy + 1408.0/2565.0*k3.dvy + 2197.0/4104.0*k4.dvy - 1.0/5.0*k5.dvy) * effectiveDt;
-        double dvz4 = (25.0/216.0*k1.dvz + 1408.0/2565.0*k3.dvz + 2197.0/4104.0*k4.dvz - 1.0/5.0*k5.dvz) * effectiveDt;
+            // Update velocities similarly
+            double dvx4 = (25.0/216.0*k1.dvx + 1408.0/2565.0*k3.dvx + 2197.0/4104.0*k4.dvx - 1.0/5.0*k5.dvx) * effectiveDt;
+            double dvy4 = (25.0/216.0*k1.dvy + 1408.0/2565.0*k3.dvy + 2197.0/4104.0*k4.dvy - 1.0/5.0*k5.dvy) * effectiveDt;
+            double dvz4 = (25.0/216.0*k1.dvz + 1408.0/2565.0*k3.dvz + 2197.0/4104.0*k4.dvz - 1.0/5.0*k5.dvz) * effectiveDt;
+        
+            double dvx5 = (16.0/135.0*k1.dvx + 6656.0/12825.0*k3.dvx + 28561.0/56430.0*k4.dvx - 9.0/50.0*k5.dvx + 2.0/55.0*k6.dvx) * effectiveDt;
+            double dvy5 = (16.0/135.0*k1.dvy + 6656.0/12825.0*k3.dvy + 28561.0/56430.0*k4.dvy - 9.0/50.0*k5.dvy + 2.0/55.0*k6.dvy) * effectiveDt;
+            double dvz5 = (16.0/135.0*k1.dvz + 6656.0/12825.0*k3.dvz + 28561.0/56430.0*k4.dvz - 9.0/50.0*k5.dvz + 2.0/55.0*k6.dvz) * effectiveDt;
+        
+            nextBodies[i].vx = bodies[i].vx + dvx5;
+            nextBodies[i].vy = bodies[i].vy + dvy5;
+            nextBodies[i].vz = bodies[i].vz + dvz5;
+        
+            // Adaptive step size control (for future enhancement)
+            // Could adjust dt based on error, but kept simple for now
+            if (error > rkfTolerance && effectiveDt > minDt) {
+                // Step too large, should reduce (handled by user dt control for now)
+                PROFILE_COUNT(rkf45Rejections, 1.0);
+            } else if (error < rkfTolerance * 0.1 && effectiveDt < maxDt) {
+                // Could increase step size
+            }
+        }
+    }
+    
+    std::copy(nextBodies.begin(), nextBodies.end(), bodies.begin());
+    handleCollisions();
+}
+
+/**
+ * PHYSICS: 4th-order Hermite Predictor-Corrector (Makino & Aarseth 1992)
+ * 
+ * Acceleration and jerk come from one fused pairwise pass
+ * (r = x_j - x_i, v = v_j - v_i, r² optionally softened):
+ *   a_i = Σ G m_j r / r³
+ *   j_i = Σ G m_j [v / r³ - 3 (r·v) r / r⁵]
+ * 
+ * Predictor (Taylor series to the jerk):
+ *   x_p = x + v h + a h²/2 + j h³/6
+ *   v_p = v + a h + j h²/2
+ * Corrector, with a1 and j1 evaluated at the predicted state:
+ *   v1 = v + (a + a1) h/2 + (j - j1) h²/12
+ *   x1 = x + (v + v1) h/2 + (a - a1) h²/12
+ * 
+ * 4th order for one force evaluation per step (RK4 needs four): a1 and j1
+ * are reused as the start of the next step while the state is untouched.
+ * 
+ * Step size (Aarseth's criterion, shared by all bodies):
+ *   h = η min_i sqrt((|a||a⁽²⁾| + |j|²) / (|j||a⁽³⁾| + |a⁽²⁾|²))
+ * with snap a⁽²⁾ and crackle a⁽³⁾ from the step's Hermite interpolant,
+ * and h = η_s min_i |a| / |j| on the first step. Each call advances
+ * dt * timeScale in substeps no longer than h (at most hermiteMaxSubsteps),
+ * so a well-resolved orbit costs exactly one evaluation per call.
+ */
+template <bool Softened>
+void hermiteKernel(const Body* b, size_t n, HermiteDerivatives* out) {
+    const double softeningSq = softeningLength * softeningLength;
+    for (size_t i = 0; i < n; i++) {
+        out[i] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+    }
+    
+    for (size_t i = 0; i < n; i++) {
+        for (size_t j = i + 1; j < n; j++) {
+            double dx = b[j].x - b[i].x;
+            double dy = b[j].y - b[i].y;
+            double dz = b[j].z - b[i].z;
+            double dvx = b[j].vx - b[i].vx;
+            double dvy = b[j].vy - b[i].vy;
+            double dvz = b[j].vz - b[i].vz;
+            double distSq = dx * dx + dy * dy + dz * dz;
+            if constexpr (Softened) {
+                distSq += softeningSq;
+            }
+            double invDistSq = 1.0 / distSq;
+            double invDist3 = invDistSq * sqrt(invDistSq);
+            double rv = 3.0 * (dx * dvx + dy * dvy + dz * dvz) * invDistSq;
+            
+            // a = r / r³, j = (v - 3 (r·v) r / r²) / r³, scaled by G m per side
+            double jx = (dvx - rv * dx) * invDist3;
+            double jy = (dvy - rv * dy) * invDist3;
+            double jz = (dvz - rv * dz) * invDist3;
+            double gmi = G * b[i].mass;
+            double gmj = G * b[j].mass;
+            
+            out[i].ax += gmj * dx * invDist3;
+            out[i].ay += gmj * dy * invDist3;
+            out[i].az += gmj * dz * invDist3;
+            out[i].jx += gmj * jx;
+            out[i].jy += gmj * jy;
+            out[i].jz += gmj * jz;
+            out[j].ax -= gmi * dx * invDist3;
+            out[j].ay -= gmi * dy * invDist3;
+            out[j].az -= gmi * dz * invDist3;
+            out[j].jx -= gmi * jx;
+            out[j].jy -= gmi * jy;
+            out[j].jz -= gmi * jz;
+        }
+    }
+}
+
+void evaluateHermite(const std::vector<Body>& state, std::vector<HermiteDerivatives>& out) {
+    PROFILE_PHASE(PHASE_FORCES);
+    PROFILE_COUNT(pairInteractions, 0.5 * state.size() * (state.size() - 1.0));
+    out.resize(state.size());
+    if (softeningLength > 0.0) {
+        hermiteKernel<true>(state.data(), state.size(), out.data());
+    } else {
+        hermiteKernel<false>(state.data(), state.size(), out.data());
+    }
+}
+
+// True while hermiteStart still describes the current bodies: nothing has
+// edited, merged or bounced them and G/softening are unchanged since the
+// last Hermite step
+bool hermiteStartValid() {
+    const std::vector<Body>& cached = stepScratch.hermiteBodies;
+    if (hermiteStepSize <= 0.0 || cached.size() != bodies.size() ||
+        hermiteG != G || hermiteSoftening != softeningLength) {
+        return false;
+    }
+    for (size_t i = 0; i < bodies.size(); i++) {
+        const Body& a = bodies[i];
+        const Body& c = cached[i];
+        if (a.x != c.x || a.y != c.y || a.z != c.z || a.vx != c.vx ||
+            a.vy != c.vy || a.vz != c.vz || a.mass != c.mass) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Startup step: η_s min |a| / |j|
+double hermiteStartupStep(const std::vector<HermiteDerivatives>& d) {
+    double step = INFINITY;
+    for (const HermiteDerivatives& h : d) {
+        double a = sqrt(h.ax * h.ax + h.ay * h.ay + h.az * h.az);
+        double j = sqrt(h.jx * h.jx + h.jy * h.jy + h.jz * h.jz);
+        if (j > 0.0) {
+            step = std::min(step, hermiteStartEta * a / j);
+        }
+    }
+    return step;
+}
+
+void updateBodiesHermite() {
+    double effectiveDt = dt * timeScale;
+    const size_t n = bodies.size();
+    std::vector<HermiteDerivatives>& start = stepScratch.hermiteStart;
+    std::vector<HermiteDerivatives>& end = stepScratch.hermiteEnd;
+    std::vector<Body>& predicted = stepScratch.stageBodies;
+    if (n != kernelBodyCount) {
+        selectKernels();   // Sizes the scratch buffers
+    }
+    
+    if (!hermiteStartValid()) {
+        evaluateHermite(bodies, start);
+        hermiteStepSize = hermiteStartupStep(start);
+        hermiteG = G;
+        hermiteSoftening = softeningLength;
+    }
+    
+    const double span = fabs(effectiveDt);
+    const double direction = effectiveDt < 0.0 ? -1.0 : 1.0;
+    double remaining = span;
+    while (remaining > 0.0) {
+        double h = std::max(hermiteStepSize, span / hermiteMaxSubsteps);
+        // Take the rest in one go rather than leave a sliver substep
+        if (h >= remaining * (1.0 - 1e-9)) {
+            h = remaining;
+        }
+        remaining -= h;
+        h *= direction;
         
-        double dvx5 = (16.0/135.0*k1.dvx + 6656.0/12825.0*k3.dvx + 28561.0/56430.0*k4.dvx - 9.0/50.0*k5.dvx + 2.0/55.0*k6.dvx) * effectiveDt;
-        double dvy5 = (16.0/135.0*k1.dvy + 6656.0/12825.0*k3.dvy + 28561.0/56430.0*k4.dvy - 9.0/50.0*k5.dvy + 2.0/55.0*k6.dvy) * effectiveDt;
-        double dvz5 = (16.0/135.0*k1.dvz + 6656.0/12825.0*k3.dvz + 28561.0/56430.0*k4.dvz - 9.0/50.0*k5.dvz + 2.0/55.0*k6.dvz) * effectiveDt;
+        // Predict
+        predicted.assign(bodies.begin(), bodies.end());
+        double h2 = h * h / 2.0, h3 = h * h * h / 6.0;
+        for (size_t i = 0; i < n; i++) {
+            const HermiteDerivatives& d = start[i];
+            Body& p = predicted[i];
+            p.x += p.vx * h + d.ax * h2 + d.jx * h3;
+            p.y += p.vy * h + d.ay * h2 + d.jy * h3;
+            p.z += p.vz * h + d.az * h2 + d.jz * h3;
+            p.vx += d.ax * h + d.jx * h2;
+            p.vy += d.ay * h + d.jy * h2;
+            p.vz += d.az * h + d.jz * h2;
+        }
         
-        nextBodies[i].vx = bodies[i].vx + dvx5;
-        nextBodies[i].vy = bodies[i].vy + dvy5;
-        nextBodies[i].vz = bodies[i].vz + dvz5;
+        evaluateHermite(predicted, end);
         
-        // Adaptive step size control (for future enhancement)
-        // Could adjust dt based on error, but kept simple for now
-        if (error > rkfTolerance && effectiveDt > minDt) {
-            // Step too large, should reduce (handled by user dt control for now)
-        } else if (error < rkfTolerance * 0.1 && effectiveDt < maxDt) {
-            // Could increase step size
+        // Correct, and evaluate the criterion for the next step
+        double nextStep = INFINITY;
+        double hh = h * h / 12.0;
+        for (size_t i = 0; i < n; i++) {
+            const HermiteDerivatives& d0 = start[i];
+            const HermiteDerivatives& d1 = end[i];
+            Body& b = bodies[i];
+            double vx = b.vx + (d0.ax + d1.ax) * h / 2.0 + (d0.jx - d1.jx) * hh;
+            double vy = b.vy + (d0.ay + d1.ay) * h / 2.0 + (d0.jy - d1.jy) * hh;
+            double vz = b.vz + (d0.az + d1.az) * h / 2.0 + (d0.jz - d1.jz) * hh;
+            b.x += (b.vx + vx) * h / 2.0 + (d0.ax - d1.ax) * hh;
+            b.y += (b.vy + vy) * h / 2.0 + (d0.ay - d1.ay) * hh;
+            b.z += (b.vz + vz) * h / 2.0 + (d0.az - d1.az) * hh;
+            b.vx = vx;
+            b.vy = vy;
+            b.vz = vz;
+            b.ax = d1.ax;
+            b.ay = d1.ay;
+            b.az = d1.az;
+            
+            // Snap and crackle at the end of the step from the interpolant
+            double invH2 = 1.0 / (h * h);
+            double cx = (12.0 * (d0.ax - d1.ax) + 6.0 * h * (d0.jx + d1.jx)) * invH2 / h;
+            double cy = (12.0 * (d0.ay - d1.ay) + 6.0 * h * (d0.jy + d1.jy)) * invH2 / h;
+            double cz = (12.0 * (d0.az - d1.az) + 6.0 * h * (d0.jz + d1.jz)) * invH2 / h;
+            double sx = (-6.0 * (d0.ax - d1.ax) - h * (4.0 * d0.jx + 2.0 * d1.jx)) * invH2 + h * cx;
+            double sy = (-6.0 * (d0.ay - d1.ay) - h * (4.0 * d0.jy + 2.0 * d1.jy)) * invH2 + h * cy;
+            double sz = (-6.0 * (d0.az - d1.az) - h * (4.0 * d0.jz + 2.0 * d1.jz)) * invH2 + h * cz;
+            double a = sqrt(d1.ax * d1.ax + d1.ay * d1.ay + d1.az * d1.az);
+            double j = sqrt(d1.jx * d1.jx + d1.jy * d1.jy + d1.jz * d1.jz);
+            double snap = sqrt(sx * sx + sy * sy + sz * sz);
+            double crackle = sqrt(cx * cx + cy * cy + cz * cz);
+            double denominator = j * crackle + snap * snap;
+            if (denominator > 0.0) {
+                nextStep = std::min(nextStep, hermiteEta * sqrt((a * snap + j * j) / denominator));
+            }
         }
+        hermiteStepSize = nextStep;
+        start.swap(end);
     }
     
-    bodies = nextBodies;
+    // hermiteStart now matches this state; collisions below invalidate it
+    stepScratch.hermiteBodies.assign(bodies.begin(), bodies.end());
     handleCollisions();
 }
 
@@ -1049,8 +2906,14 @@ void updateBodiesRKF45() {
  * Calculate system properties for physics analysis (3D, PDF Section 2.2)
  * Implements conservation law monitoring as per classical mechanics
  * Tracks all 10 conserved quantities: E, Px, Py, Pz, Lx, Ly, Lz, CMx, CMy, CMz
+ * 
+ * Not run every step: getters go through ensureDiagnostics(), and
+ * sampleDrift() evaluates it at the drift-sampling cadence.
  */
+TaskCosts potentialCosts;
+
 void calculateSystemProperties() {
+    PROFILE_PHASE(PHASE_DIAGNOSTICS);
     double totalMass = 0.0;
     double cmX = 0.0, cmY = 0.0, cmZ = 0.0;
     double momX = 0.0, momY = 0.0, momZ = 0.0;
@@ -1094,16 +2957,32 @@ void calculateSystemProperties() {
     angularMomentumY = angularMomY;
     angularMomentumZ = angularMomZ;
     
-    // Potential energy: PE = -G * m1 * m2 / r
-    for (size_t i = 0; i < bodies.size(); i++) {
-        for (size_t j = i + 1; j < bodies.size(); j++) {
-            double dx = bodies[j].x - bodies[i].x;
-            double dy = bodies[j].y - bodies[i].y;
-            double dz = bodies[j].z - bodies[i].z;
-            double dist = sqrt(dx * dx + dy * dy + dz * dz);
-            dist = fmax(dist, 1.0);
-            
-            potentialE -= G * bodies[i].mass * bodies[j].mass / dist;
+    // Potential energy: PE = -G * m1 * m2 / r (from the mesh in particle-mesh runs)
+    if (particleMeshEnabled) {
+        potentialE = particleMeshPotentialEnergy();
+    } else {
+        // Summed per row, then over rows in order: the same total for any
+        // worker count
+        const size_t n = bodies.size();
+        std::vector<double>& rowSums = stepScratch.rowSums;
+        rowSums.resize(n);
+        parallelFor(potentialCosts, n, 16, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                double row = 0.0;
+                for (size_t j = i + 1; j < n; j++) {
+                    double dx = bodies[j].x - bodies[i].x;
+                    double dy = bodies[j].y - bodies[i].y;
+                    double dz = bodies[j].z - bodies[i].z;
+                    double dist = sqrt(dx * dx + dy * dy + dz * dz);
+                    dist = fmax(dist, 1.0 / unitLength);   // 1 scaled unit, or 1 m in SI mode
+                    
+                    row -= G * bodies[i].mass * bodies[j].mass / dist;
+                }
+                rowSums[i] = row;
+            }
+        });
+        for (size_t i = 0; i < n; i++) {
+            potentialE += rowSums[i];
         }
     }
     
@@ -1139,81 +3018,2600 @@ void calculateSystemProperties() {
     } else {
         angularMomentumDrift = angMomMag;
     }
+    
+    diagnosticsDirty = false;
+}
+
+extern "C" void saveInitialState();
+
+// Recompute system properties only if the state changed since the last call
+void ensureDiagnostics() {
+    if (diagnosticsDirty) {
+        calculateSystemProperties();
+    }
+    if (baselinePending) {
+        baselinePending = false;
+        saveInitialState();
+    }
+}
+
+// Capture conservation baselines at the first diagnostics read or step
+// instead of immediately, so large scenes load in O(N)
+void requestBaseline() {
+    baselinePending = true;
+    markDiagnosticsDirty();
+}
+
+void accumulateDrift(DriftStats& stats, double drift) {
+    if (drift > stats.max || stats.samples == 0) {
+        stats.max = drift;
+        stats.timeOfMax = simulationTime;
+    }
+    stats.sumSq += drift * drift;
+    stats.samples++;
+}
+
+double driftRMS(const DriftStats& stats) {
+    return stats.samples > 0 ? sqrt(stats.sumSq / stats.samples) : 0.0;
+}
+
+void resetDriftStats() {
+    energyDriftStats = DriftStats();
+    momentumDriftStats = DriftStats();
+    angularMomentumDriftStats = DriftStats();
+    stepsSinceDriftSample = 0;
+}
+
+// Called once per step: evaluate diagnostics at the sampling cadence only
+void sampleDrift() {
+    if (driftSampleInterval <= 0 || ++stepsSinceDriftSample < driftSampleInterval) {
+        return;
+    }
+    stepsSinceDriftSample = 0;
+    ensureDiagnostics();
+    accumulateDrift(energyDriftStats, energyDrift);
+    accumulateDrift(momentumDriftStats, momentumDrift);
+    accumulateDrift(angularMomentumDriftStats, angularMomentumDrift);
+}
+
+/**
+ * KEPLER FAST-FORWARD: analytic steps for hierarchical systems
+ * 
+ * When every body but the heaviest (the primary) moves on an effectively
+ * unperturbed conic around it, a step of any length is solved in closed
+ * form instead of integrated. Each secondary k is propagated relative to
+ * the primary with μ = G (M + m_k) by the universal-variable Kepler
+ * equation (Stumpff functions c(z), s(z), z = α χ², α = 1/a):
+ *   √μ t = σ0 χ² c + (1 - α r0) χ³ s + r0 χ,   σ0 = r0·v0 / √μ
+ * solved for χ with Laguerre's method (robust for ellipses, parabolas
+ * and hyperbolas alike), then r = f r0 + g v0, v = ḟ r0 + ġ v0.
+ * The primary follows from the barycentre, which moves uniformly.
+ * 
+ * An isolated pair is exact. With more secondaries the hierarchy holds
+ * while, for each of them, the direct and indirect pulls of the others
+ * stay below keplerTolerance of the primary's pull; otherwise (or with
+ * softening, force terms or the particle mesh) the step falls back to the
+ * selected integrator. The in-step state of an analytic step is itself
+ * analytic, so events, closest approaches and swept collisions stay exact
+ * over long jumps (see relativeStateInStep).
+ */
+bool keplerFastForward = false;     // Try an analytic step before integrating
+double keplerTolerance = 1e-6;      // Max perturbation / primary pull per secondary
+double keplerJumpFraction = 0.1;    // Multi-secondary jumps, in dynamical times
+int keplerStepPrimary = -1;         // Primary of the last step if it was analytic
+
+// Stumpff functions c(z) = (1 - cos √z) / z, s(z) = (√z - sin √z) / √z³
+void stumpff(double z, double& c, double& s) {
+    if (fabs(z) < 0.1) {
+        // Series: c = Σ (-z)^k / (2k + 2)!, s = Σ (-z)^k / (2k + 3)!
+        double cTerm = 0.5, sTerm = 1.0 / 6.0;
+        c = 0.0;
+        s = 0.0;
+        for (int k = 0; k < 8; k++) {
+            c += cTerm;
+            s += sTerm;
+            cTerm *= -z / ((2.0 * k + 3.0) * (2.0 * k + 4.0));
+            sTerm *= -z / ((2.0 * k + 4.0) * (2.0 * k + 5.0));
+        }
+    } else if (z > 0.0) {
+        double root = sqrt(z);
+        double half = sin(0.5 * root);
+        c = 2.0 * half * half / z;
+        s = (root - sin(root)) / (z * root);
+    } else {
+        double root = sqrt(-z);
+        double half = sinh(0.5 * root);
+        c = -2.0 * half * half / z;
+        s = (sinh(root) - root) / (-z * root);
+    }
+}
+
+/**
+ * Relative state (r, v) after time t (either sign) on the conic through
+ * (r0, v0) about μ. Returns false if χ did not converge.
+ */
+bool keplerPropagate(double mu, const double r0[3], const double v0[3], double t, double r[3], double v[3]) {
+    double r0Mag = sqrt(r0[0] * r0[0] + r0[1] * r0[1] + r0[2] * r0[2]);
+    if (mu <= 0.0 || r0Mag == 0.0) return false;
+    double v0Sq = v0[0] * v0[0] + v0[1] * v0[1] + v0[2] * v0[2];
+    double sqrtMu = sqrt(mu);
+    double sigma0 = (r0[0] * v0[0] + r0[1] * v0[1] + r0[2] * v0[2]) / sqrtMu;
+    double alpha = 2.0 / r0Mag - v0Sq / mu;
+    
+    if (alpha > 0.0) {
+        // Whole periods change nothing on an ellipse; keeps χ small
+        double period = 2.0 * M_PI / (sqrtMu * alpha * sqrt(alpha));
+        t = fmod(t, period);
+    }
+    
+    const double order = 5.0;   // Laguerre's n
+    double chi = alpha > 0.0 ? sqrtMu * alpha * t : sqrtMu * t / r0Mag;
+    double z = 0.0, c = 0.5, s = 1.0 / 6.0;
+    bool converged = false;
+    for (int iteration = 0; iteration < 50 && !converged; iteration++) {
+        z = alpha * chi * chi;
+        stumpff(z, c, s);
+        double f = sigma0 * chi * chi * c + (1.0 - alpha * r0Mag) * chi * chi * chi * s +
+                   r0Mag * chi - sqrtMu * t;
+        double df = sigma0 * chi * (1.0 - z * s) + (1.0 - alpha * r0Mag) * chi * chi * c + r0Mag;
+        double ddf = sigma0 * (1.0 - z * c) + (1.0 - alpha * r0Mag) * chi * (1.0 - z * s);
+        double root = sqrt(fabs((order - 1.0) * (order - 1.0) * df * df - order * (order - 1.0) * f * ddf));
+        double delta = order * f / (df + (df >= 0.0 ? root : -root));
+        if (!std::isfinite(delta)) return false;
+        chi -= delta;
+        converged = fabs(delta) <= 1e-12 * fabs(chi);
+    }
+    if (!converged) return false;
+    
+    z = alpha * chi * chi;
+    stumpff(z, c, s);
+    double f = 1.0 - chi * chi * c / r0Mag;
+    double g = t - chi * chi * chi * s / sqrtMu;
+    for (int k = 0; k < 3; k++) {
+        r[k] = f * r0[k] + g * v0[k];
+    }
+    double rMag = sqrt(r[0] * r[0] + r[1] * r[1] + r[2] * r[2]);
+    double df = sqrtMu / (rMag * r0Mag) * chi * (z * s - 1.0);
+    double dg = 1.0 - chi * chi * c / rMag;
+    for (int k = 0; k < 3; k++) {
+        v[k] = df * r0[k] + dg * v0[k];
+    }
+    return std::isfinite(rMag) && rMag > 0.0;
+}
+
+// Primary whose secondaries all move on unperturbed conics, or -1
+int findKeplerPrimary() {
+    const size_t n = bodies.size();
+    if (n < 2 || softeningLength > 0.0 || activeForceTermCount > 0 || particleMeshEnabled) {
+        return -1;
+    }
+    size_t p = 0;
+    for (size_t i = 1; i < n; i++) {
+        if (bodies[i].mass > bodies[p].mass) p = i;
+    }
+    const Body& primary = bodies[p];
+    if (G * primary.mass <= 0.0) return -1;
+    
+    for (size_t k = 0; k < n; k++) {
+        if (k == p) continue;
+        const Body& b = bodies[k];
+        double dx = b.x - primary.x, dy = b.y - primary.y, dz = b.z - primary.z;
+        double rSq = dx * dx + dy * dy + dz * dz;
+        if (rSq == 0.0) return -1;
+        double central = G * (primary.mass + b.mass) / rSq;
+        
+        // Direct pull of each other secondary plus its indirect pull
+        // (through the primary's reflex motion) on k's relative orbit
+        double perturbation = 0.0;
+        for (size_t j = 0; j < n; j++) {
+            if (j == p || j == k) continue;
+            const Body& o = bodies[j];
+            double ex = o.x - b.x, ey = o.y - b.y, ez = o.z - b.z;
+            double fx = o.x - primary.x, fy = o.y - primary.y, fz = o.z - primary.z;
+            double directSq = ex * ex + ey * ey + ez * ez;
+            double indirectSq = fx * fx + fy * fy + fz * fz;
+            if (directSq == 0.0 || indirectSq == 0.0) return -1;
+            perturbation += G * o.mass * (1.0 / directSq + 1.0 / indirectSq);
+        }
+        if (perturbation > keplerTolerance * central) return -1;
+    }
+    return static_cast<int>(p);
+}
+
+// State of body k relative to the primary, t after the state `start`
+void keplerRelativeState(const std::vector<Body>& start, int primary, int k, double t,
+                         double rel[3], double relVel[3]) {
+    if (k == primary) {
+        rel[0] = rel[1] = rel[2] = 0.0;
+        relVel[0] = relVel[1] = relVel[2] = 0.0;
+        return;
+    }
+    const Body& p = start[primary];
+    const Body& b = start[k];
+    const double r0[3] = { b.x - p.x, b.y - p.y, b.z - p.z };
+    const double v0[3] = { b.vx - p.vx, b.vy - p.vy, b.vz - p.vz };
+    if (!keplerPropagate(G * (p.mass + b.mass), r0, v0, t, rel, relVel)) {
+        std::copy(r0, r0 + 3, rel);
+        std::copy(v0, v0 + 3, relVel);
+    }
+}
+
+// Absolute state of the primary: barycentre minus the secondaries' share
+void keplerPrimaryState(const std::vector<Body>& start, int primary, double t,
+                        double pos[3], double vel[3]) {
+    double totalMass = 0.0;
+    double cm[3] = {}, cmVel[3] = {};
+    double shift[3] = {}, shiftVel[3] = {};
+    for (size_t k = 0; k < start.size(); k++) {
+        const Body& b = start[k];
+        totalMass += b.mass;
+        cm[0] += b.mass * b.x;
+        cm[1] += b.mass * b.y;
+        cm[2] += b.mass * b.z;
+        cmVel[0] += b.mass * b.vx;
+        cmVel[1] += b.mass * b.vy;
+        cmVel[2] += b.mass * b.vz;
+        if (static_cast<int>(k) == primary || b.mass == 0.0) continue;
+        double rel[3], relVel[3];
+        keplerRelativeState(start, primary, static_cast<int>(k), t, rel, relVel);
+        for (int c = 0; c < 3; c++) {
+            shift[c] += b.mass * rel[c];
+            shiftVel[c] += b.mass * relVel[c];
+        }
+    }
+    for (int c = 0; c < 3; c++) {
+        pos[c] = (cm[c] + cmVel[c] * t - shift[c]) / totalMass;
+        vel[c] = (cmVel[c] - shiftVel[c]) / totalMass;
+    }
+}
+
+// State of a relative to b (absolute if b < 0), t into an analytic step
+void keplerStateInStep(const std::vector<Body>& start, int primary, int a, int b, double t,
+                       double rel[3], double relVel[3]) {
+    keplerRelativeState(start, primary, a, t, rel, relVel);
+    double other[3], otherVel[3];
+    if (b >= 0) {
+        keplerRelativeState(start, primary, b, t, other, otherVel);
+        for (int c = 0; c < 3; c++) {
+            rel[c] -= other[c];
+            relVel[c] -= otherVel[c];
+        }
+    } else {
+        keplerPrimaryState(start, primary, t, other, otherVel);
+        for (int c = 0; c < 3; c++) {
+            rel[c] += other[c];
+            relVel[c] += otherVel[c];
+        }
+    }
+}
+
+// Analytic step of length h; false (bodies untouched) if a solve failed
+bool advanceKepler(int primary, double h) {
+    std::vector<Body>& next = stepScratch.stageBodies;
+    next.assign(bodies.begin(), bodies.end());
+    const Body& p = bodies[primary];
+    double totalMass = 0.0;
+    double cm[3] = {}, cmVel[3] = {};
+    double shift[3] = {}, shiftVel[3] = {};
+    for (size_t k = 0; k < bodies.size(); k++) {
+        const Body& b = bodies[k];
+        totalMass += b.mass;
+        cm[0] += b.mass * b.x;
+        cm[1] += b.mass * b.y;
+        cm[2] += b.mass * b.z;
+        cmVel[0] += b.mass * b.vx;
+        cmVel[1] += b.mass * b.vy;
+        cmVel[2] += b.mass * b.vz;
+        if (static_cast<int>(k) == primary) continue;
+        
+        // Relative state for now; the primary's position is added below
+        const double r0[3] = { b.x - p.x, b.y - p.y, b.z - p.z };
+        const double v0[3] = { b.vx - p.vx, b.vy - p.vy, b.vz - p.vz };
+        double r[3], v[3];
+        if (!keplerPropagate(G * (p.mass + b.mass), r0, v0, h, r, v)) {
+            return false;
+        }
+        Body& out = next[k];
+        out.x = r[0];
+        out.y = r[1];
+        out.z = r[2];
+        out.vx = v[0];
+        out.vy = v[1];
+        out.vz = v[2];
+        for (int c = 0; c < 3; c++) {
+            shift[c] += b.mass * r[c];
+            shiftVel[c] += b.mass * v[c];
+        }
+    }
+    
+    double pos[3], vel[3];
+    for (int c = 0; c < 3; c++) {
+        pos[c] = (cm[c] + cmVel[c] * h - shift[c]) / totalMass;
+        vel[c] = (cmVel[c] - shiftVel[c]) / totalMass;
+    }
+    for (size_t k = 0; k < next.size(); k++) {
+        Body& b = next[k];
+        if (static_cast<int>(k) == primary) {
+            b.x = b.y = b.z = b.vx = b.vy = b.vz = 0.0;
+        }
+        b.x += pos[0];
+        b.y += pos[1];
+        b.z += pos[2];
+        b.vx += vel[0];
+        b.vy += vel[1];
+        b.vz += vel[2];
+    }
+    std::copy(next.begin(), next.end(), bodies.begin());
+    handleCollisions();
+    return true;
+}
+
+/**
+ * Closest approach over the next horizon on the conic through (r0, v0):
+ * the periapsis distance if the next periapsis passage falls inside the
+ * horizon, otherwise the nearer end (r is monotonic up to it).
+ */
+double keplerClosestApproach(double mu, const double r0[3], const double v0[3], double horizon) {
+    double r0Mag = sqrt(r0[0] * r0[0] + r0[1] * r0[1] + r0[2] * r0[2]);
+    double v0Sq = v0[0] * v0[0] + v0[1] * v0[1] + v0[2] * v0[2];
+    double sqrtMu = sqrt(mu);
+    double sigma0 = (r0[0] * v0[0] + r0[1] * v0[1] + r0[2] * v0[2]) / sqrtMu;
+    double alpha = 2.0 / r0Mag - v0Sq / mu;
+    double hx = r0[1] * v0[2] - r0[2] * v0[1];
+    double hy = r0[2] * v0[0] - r0[0] * v0[2];
+    double hz = r0[0] * v0[1] - r0[1] * v0[0];
+    double semiLatus = (hx * hx + hy * hy + hz * hz) / mu;
+    double e = sqrt(std::max(0.0, 1.0 - semiLatus * alpha));
+    double periapsis = semiLatus / (1.0 + e);
+    
+    // Time to the next periapsis passage (mean anomaly M measured from it)
+    double timeToPeriapsis = -1.0;
+    if (e > 1e-12 && alpha > 0.0) {
+        double E = atan2(sigma0 * sqrt(alpha), 1.0 - alpha * r0Mag);
+        double M = E - e * sin(E);
+        double meanMotion = sqrtMu * alpha * sqrt(alpha);
+        timeToPeriapsis = (M <= 0.0 ? -M : 2.0 * M_PI - M) / meanMotion;
+    } else if (e > 1e-12 && alpha < 0.0 && sigma0 < 0.0) {
+        double F = asinh(sigma0 * sqrt(-alpha) / e);
+        double M = e * sinh(F) - F;
+        timeToPeriapsis = -M / (sqrtMu * -alpha * sqrt(-alpha));
+    }
+    if (timeToPeriapsis >= 0.0 && timeToPeriapsis <= horizon) {
+        return periapsis;
+    }
+    
+    double r[3], v[3];
+    if (!keplerPropagate(mu, r0, v0, horizon, r, v)) return -1.0;
+    return std::min(r0Mag, sqrt(r[0] * r[0] + r[1] * r[1] + r[2] * r[2]));
+}
+
+/**
+ * EVENTS: precise crossings, close approaches and impacts inside a step
+ * 
+ * Registered event functions g(t) are checked after every step for a sign
+ * change. Each step's motion is reconstructed from the states at both ends
+ * by cubic Hermite interpolation (positions + velocities, see
+ * hermiteInterpolate), and roots are located on it with the Illinois
+ * method, so events keep their accuracy at large dt:
+ *   distance:  g = |rA - rB| - threshold
+ *   approach:  g = (rA - rB)·(vA - vB), rising through 0 at each minimum
+ *   plane:     g = (rA - rB)[axis] - offset  (rB = 0 when bodyB < 0)
+ * A distance threshold crossed and re-crossed within one step (a fast body
+ * tunnelling through a planet) is caught by splitting the step at the
+ * in-step closest approach first.
+ * 
+ * Hits go to a fixed ring buffer drained by drainEvents(); each record is
+ * EVENT_RECORD_STRIDE doubles (see EventRecordField).
+ */
+enum EventType {
+    EVENT_DISTANCE,
+    EVENT_APPROACH,
+    EVENT_PLANE
+};
+
+enum EventRecordField {
+    EVENT_TIME,                 // Simulation time of the event
+    EVENT_ID,
+    EVENT_TYPE,
+    EVENT_BODY_A,
+    EVENT_BODY_B,
+    EVENT_X, EVENT_Y, EVENT_Z,  // State of body A at the event
+    EVENT_VX, EVENT_VY, EVENT_VZ,
+    EVENT_DIRECTION,            // +1 g rising, -1 g falling
+    EVENT_SEPARATION,           // |rA - rB| at the event
+    EVENT_RECORD_STRIDE
+};
+
+struct EventDefinition {
+    EventType type;
+    int bodyA;
+    int bodyB;          // -1 = origin (plane events only)
+    int axis;           // Plane events: 0 = x, 1 = y, 2 = z
+    double threshold;   // Distance threshold or plane offset
+    int direction;      // +1 rising only, -1 falling only, 0 both
+    bool active;
+    bool logged;        // false: only feeds phase samplers (see PHASE SAMPLERS)
+};
+
+const int EVENT_LOG_CAPACITY = 4096;
+std::vector<EventDefinition> eventDefinitions;
+std::vector<double> eventLog;          // Ring buffer of EVENT_LOG_CAPACITY records
+int eventLogStart = 0;
+int eventLogCount = 0;
+long eventsDropped = 0;                // Overwritten before being drained
+
+// State at the start of the current step (captured only when needed)
+std::vector<Body> stepStartBodies;
+double stepStartTime = 0.0;
+double stepSize = 0.0;
+bool stepStartValid = false;
+
+bool needStepStart() {
+    return !eventDefinitions.empty() || gameMode == GAME_MODE_ACTIVE ||
+           (enableCollisions && continuousCollisions);
+}
+
+// True while the last step was analytic and its bodies are still in place
+bool keplerStepInStep() {
+    return keplerStepPrimary >= 0 && stepStartBodies.size() == bodies.size();
+}
+
+// Relative position/velocity of a with respect to b (origin if b < 0) at
+// fraction s of the last step (on the conics after an analytic step)
+void relativeStateInStep(int a, int b, double s, double rel[3], double relVel[3]) {
+    if (keplerStepInStep()) {
+        keplerStateInStep(stepStartBodies, keplerStepPrimary, a, b, s * stepSize, rel, relVel);
+        return;
+    }
+    hermiteInterpolate(stepStartBodies[a], bodies[a], stepSize, s, rel, relVel);
+    if (b >= 0) {
+        double pb[3], vb[3];
+        hermiteInterpolate(stepStartBodies[b], bodies[b], stepSize, s, pb, vb);
+        for (int k = 0; k < 3; k++) {
+            rel[k] -= pb[k];
+            relVel[k] -= vb[k];
+        }
+    }
+}
+
+// g for the event's own condition (rate = false) or for the approach
+// condition between its bodies (rate = true)
+double eventValueInStep(const EventDefinition& event, bool rate, double s) {
+    double rel[3], relVel[3];
+    relativeStateInStep(event.bodyA, event.bodyB, s, rel, relVel);
+    if (rate || event.type == EVENT_APPROACH) {
+        return rel[0] * relVel[0] + rel[1] * relVel[1] + rel[2] * relVel[2];
+    }
+    if (event.type == EVENT_PLANE) {
+        return rel[event.axis] - event.threshold;
+    }
+    return sqrt(rel[0] * rel[0] + rel[1] * rel[1] + rel[2] * rel[2]) - event.threshold;
+}
+
+// Illinois (modified regula falsi) root of g on [s0, s1], g0 and g1 of opposite sign
+double locateEventRoot(const EventDefinition& event, bool rate, double s0, double s1, double g0, double g1) {
+    int side = 0;
+    for (int iter = 0; iter < 60 && s1 - s0 > 1e-13; iter++) {
+        double s = (s0 * g1 - s1 * g0) / (g1 - g0);
+        double g = eventValueInStep(event, rate, s);
+        if (g == 0.0) return s;
+        if ((g < 0.0) == (g0 < 0.0)) {
+            s0 = s;
+            g0 = g;
+            if (side == -1) g1 *= 0.5;
+            side = -1;
+        } else {
+            s1 = s;
+            g1 = g;
+            if (side == 1) g0 *= 0.5;
+            side = 1;
+        }
+    }
+    return (s0 * g1 - s1 * g0) / (g1 - g0);
+}
+
+void logEvent(int id, const EventDefinition& event, double s, int direction) {
+    if (eventLog.empty()) {
+        eventLog.resize(EVENT_LOG_CAPACITY * EVENT_RECORD_STRIDE);
+    }
+    if (eventLogCount == EVENT_LOG_CAPACITY) {
+        eventLogStart = (eventLogStart + 1) % EVENT_LOG_CAPACITY;
+        eventLogCount--;
+        eventsDropped++;
+    }
+    double* record = &eventLog[((eventLogStart + eventLogCount) % EVENT_LOG_CAPACITY) * EVENT_RECORD_STRIDE];
+    eventLogCount++;
+    
+    double pos[3], vel[3], rel[3], relVel[3];
+    relativeStateInStep(event.bodyA, -1, s, pos, vel);
+    relativeStateInStep(event.bodyA, event.bodyB, s, rel, relVel);
+    record[EVENT_TIME] = stepStartTime + s * stepSize;
+    record[EVENT_ID] = id;
+    record[EVENT_TYPE] = event.type;
+    record[EVENT_BODY_A] = bodyRank(event.bodyA);
+    record[EVENT_BODY_B] = bodyRank(event.bodyB);
+    record[EVENT_X] = pos[0];
+    record[EVENT_Y] = pos[1];
+    record[EVENT_Z] = pos[2];
+    record[EVENT_VX] = vel[0];
+    record[EVENT_VY] = vel[1];
+    record[EVENT_VZ] = vel[2];
+    record[EVENT_DIRECTION] = direction;
+    record[EVENT_SEPARATION] = sqrt(rel[0] * rel[0] + rel[1] * rel[1] + rel[2] * rel[2]);
+}
+
+void recordSectionSamples(int eventId, double s);
+
+// Log a root of g on [s0, s1] if its sign changes in an accepted direction
+void detectOnInterval(int id, const EventDefinition& event, double s0, double s1, double g0, double g1) {
+    if ((g0 < 0.0) == (g1 < 0.0)) return;
+    int direction = g1 > g0 ? 1 : -1;
+    if (event.direction != 0 && event.direction != direction) return;
+    double s = locateEventRoot(event, false, s0, s1, g0, g1);
+    if (event.logged) {
+        logEvent(id, event, s, direction);
+    }
+    recordSectionSamples(id, s);
+}
+
+/**
+ * Closest approach of bodies a and b within the last step: returns the
+ * minimum separation and its step fraction. Needs a valid step start.
+ */
+double closestSeparationInStep(int a, int b, double& sAtMin) {
+    EventDefinition approach = { EVENT_APPROACH, a, b, 0, 0.0, 1, true, false };
+    double r0[3], r1[3], v[3];
+    relativeStateInStep(a, b, 0.0, r0, v);
+    relativeStateInStep(a, b, 1.0, r1, v);
+    double d0 = sqrt(r0[0] * r0[0] + r0[1] * r0[1] + r0[2] * r0[2]);
+    double d1 = sqrt(r1[0] * r1[0] + r1[1] * r1[1] + r1[2] * r1[2]);
+    sAtMin = d1 < d0 ? 1.0 : 0.0;
+    double best = std::min(d0, d1);
+    
+    double g0 = eventValueInStep(approach, true, 0.0);
+    double g1 = eventValueInStep(approach, true, 1.0);
+    if (g0 < 0.0 && g1 > 0.0) {
+        double s = locateEventRoot(approach, true, 0.0, 1.0, g0, g1);
+        double rel[3];
+        relativeStateInStep(a, b, s, rel, v);
+        double d = sqrt(rel[0] * rel[0] + rel[1] * rel[1] + rel[2] * rel[2]);
+        if (d < best) {
+            best = d;
+            sAtMin = s;
+        }
+    }
+    return best;
+}
+
+/**
+ * Continuous collisions: first step fraction at which bodies i and j come
+ * within contactDistance, or -1 if they do not (or already overlapped at
+ * the step start, which the end-of-step overlap test handles).
+ */
+double sweptContactFraction(size_t i, size_t j, double contactDistance) {
+    if (!stepStartValid || stepStartBodies.size() != bodies.size()) return -1.0;
+    EventDefinition contact = { EVENT_DISTANCE, static_cast<int>(i), static_cast<int>(j), 0,
+                                contactDistance, -1, true, false };
+    double g0 = eventValueInStep(contact, false, 0.0);
+    if (g0 <= 0.0) return -1.0;
+    
+    double g1 = eventValueInStep(contact, false, 1.0);
+    double end = 1.0;
+    if (g1 > 0.0) {
+        // Apart at both ends: only an in-step closest approach can touch
+        double r0 = eventValueInStep(contact, true, 0.0);
+        double r1 = eventValueInStep(contact, true, 1.0);
+        if (!(r0 < 0.0 && r1 > 0.0)) return -1.0;
+        end = locateEventRoot(contact, true, 0.0, 1.0, r0, r1);
+        g1 = eventValueInStep(contact, false, end);
+        if (g1 > 0.0) return -1.0;
+    }
+    return locateEventRoot(contact, false, 0.0, end, g0, g1);
+}
+
+// Put bodies i and j in their interpolated state at step fraction s
+void rewindToContact(size_t i, size_t j, double s) {
+    const bool analytic = keplerStepInStep();
+    for (size_t k : { i, j }) {
+        double pos[3], vel[3];
+        if (analytic) {
+            keplerStateInStep(stepStartBodies, keplerStepPrimary, static_cast<int>(k), -1, s * stepSize, pos, vel);
+        } else {
+            hermiteInterpolate(stepStartBodies[k], bodies[k], stepSize, s, pos, vel);
+        }
+        bodies[k].x = pos[0];
+        bodies[k].y = pos[1];
+        bodies[k].z = pos[2];
+        bodies[k].vx = vel[0];
+        bodies[k].vy = vel[1];
+        bodies[k].vz = vel[2];
+    }
+}
+
+// Snapshot the step start for in-step event location
+void beginEventStep() {
+    stepSize = dt * timeScale;
+    stepStartValid = needStepStart();
+    if (stepStartValid) {
+        stepStartBodies = bodies;
+        stepStartTime = simulationTime;
+    }
+}
+
+// Check every registered event over the step that just finished
+void detectEvents() {
+    stepSize = dt * timeScale;
+    stepStartValid = stepStartValid && stepStartBodies.size() == bodies.size();
+    if (!stepStartValid || eventDefinitions.empty()) return;
+    
+    const int n = static_cast<int>(bodies.size());
+    for (size_t id = 0; id < eventDefinitions.size(); id++) {
+        const EventDefinition& event = eventDefinitions[id];
+        if (!event.active || event.bodyA < 0 || event.bodyA >= n || event.bodyB >= n ||
+            (event.bodyB < 0 && event.type != EVENT_PLANE)) {
+            continue;
+        }
+        
+        double g0 = eventValueInStep(event, false, 0.0);
+        double g1 = eventValueInStep(event, false, 1.0);
+        if (event.type == EVENT_DISTANCE) {
+            // Split at the in-step minimum so an enter-and-leave is not missed
+            double r0 = eventValueInStep(event, true, 0.0);
+            double r1 = eventValueInStep(event, true, 1.0);
+            if (r0 < 0.0 && r1 > 0.0) {
+                double sMin = locateEventRoot(event, true, 0.0, 1.0, r0, r1);
+                double gMin = eventValueInStep(event, false, sMin);
+                detectOnInterval(static_cast<int>(id), event, 0.0, sMin, g0, gMin);
+                detectOnInterval(static_cast<int>(id), event, sMin, 1.0, gMin, g1);
+                continue;
+            }
+        }
+        detectOnInterval(static_cast<int>(id), event, 0.0, 1.0, g0, g1);
+    }
+}
+
+/**
+ * PHASE SAMPLERS: Poincaré sections and phase-space projections
+ * 
+ * Each sampler projects one body's state (relative to a reference body, or
+ * absolute) onto two phase-space coordinates and appends (u, v) pairs to
+ * its own fixed-capacity ring buffer. Section samplers sample at the exact
+ * crossings of an internal plane event; trajectory samplers sample every
+ * interval steps. JS reads the buffers in place as Float64Array views
+ * (getSamplerBuffer), so large sections cost no per-point allocations.
+ */
+enum PhaseCoordinate {
+    PHASE_X, PHASE_Y, PHASE_Z,
+    PHASE_VX, PHASE_VY, PHASE_VZ,
+    PHASE_COORDINATE_COUNT
+};
+
+struct PhaseSampler {
+    int body;
+    int reference;      // -1 = absolute coordinates
+    int coordU, coordV; // PhaseCoordinate
+    int eventId;        // Section trigger, -1 for a trajectory sampler
+    int interval;       // Trajectory samplers: steps between samples
+    int stepsSinceSample;
+    int head;           // Next pair to write
+    int count;          // Pairs held (<= capacity)
+    int capacity;
+    bool active;
+    std::vector<double> points;   // capacity (u, v) pairs
+};
+
+std::vector<PhaseSampler> phaseSamplers;
+
+void appendSample(PhaseSampler& sampler, const double rel[3], const double relVel[3]) {
+    const double phase[PHASE_COORDINATE_COUNT] = { rel[0], rel[1], rel[2], relVel[0], relVel[1], relVel[2] };
+    sampler.points[2 * sampler.head] = phase[sampler.coordU];
+    sampler.points[2 * sampler.head + 1] = phase[sampler.coordV];
+    sampler.head = (sampler.head + 1) % sampler.capacity;
+    sampler.count = std::min(sampler.count + 1, sampler.capacity);
+}
+
+// Called for every located crossing of eventId at step fraction s
+void recordSectionSamples(int eventId, double s) {
+    for (auto& sampler : phaseSamplers) {
+        if (!sampler.active || sampler.eventId != eventId) continue;
+        double rel[3], relVel[3];
+        relativeStateInStep(sampler.body, sampler.reference, s, rel, relVel);
+        appendSample(sampler, rel, relVel);
+    }
+}
+
+// Trajectory samplers, at the end of each step
+void samplePhaseSpace() {
+    const int n = static_cast<int>(bodies.size());
+    for (auto& sampler : phaseSamplers) {
+        if (!sampler.active || sampler.eventId >= 0) continue;
+        if (++sampler.stepsSinceSample < sampler.interval) continue;
+        sampler.stepsSinceSample = 0;
+        if (sampler.body < 0 || sampler.body >= n || sampler.reference >= n) continue;
+        
+        const Body& body = bodies[sampler.body];
+        double rel[3] = { body.x, body.y, body.z };
+        double relVel[3] = { body.vx, body.vy, body.vz };
+        if (sampler.reference >= 0) {
+            const Body& reference = bodies[sampler.reference];
+            rel[0] -= reference.x;
+            rel[1] -= reference.y;
+            rel[2] -= reference.z;
+            relVel[0] -= reference.vx;
+            relVel[1] -= reference.vy;
+            relVel[2] -= reference.vz;
+        }
+        appendSample(sampler, rel, relVel);
+    }
+}
+
+/**
+ * PERIODIC ORBITS: variational propagation and Newton shooting
+ * 
+ * The state y = (x, v) of all n bodies (6n values, positions first) is
+ * propagated together with its state transition matrix Φ = ∂y(t)/∂y(0).
+ * With r = x_j - x_i and s² = r² + ε², each pair has the symmetric tidal
+ * tensor T_ij = I / s³ - 3 r rᵀ / s⁵, and a variation δy = (δx, δv) obeys
+ *   δẋ_i = δv_i,   δv̇_i = Σ_j G m_j T_ij (δx_j - δx_i)
+ * All 6n columns of Φ are pushed through each pair's 3×3 block at once,
+ * with the column index innermost, from buffers sized once per body count.
+ * 
+ * The integrator is kick-drift-kick leapfrog composed to 6th order by two
+ * levels of Yoshida's triple jump (9 leapfrog stages per step):
+ *   S4(h) = S2(w1 h) S2(w0 h) S2(w1 h),  w1 = 1 / (2 - 2^(1/3))
+ *   S6(h) = S4(z1 h) S4(z0 h) S4(z1 h),  z1 = 1 / (2 - 2^(1/5))
+ * with w0 = 1 - 2 w1 and z0 = 1 - 2 z1. Variations are kicked and
+ * drifted with the same stages, so Φ is the exact Jacobian of the
+ * numerical flow and Newton converges quadratically on it.
+ * 
+ * Shooting solves y(T; y0) - y0 = 0 for (y0, T), starting from the
+ * current bodies in their barycentric frame. Each Newton step is the
+ * minimum-norm solution of [Φ - I | ẏ(T)] (Δy0, ΔT) = -(y(T) - y0),
+ * taken from an SVD (one-sided Jacobi) with singular values below
+ * 1e-10 σ_max dropped, so the symmetry directions (rotation, time
+ * shift, the family parameter) do not make the system singular.
+ * Newtonian gravity only: force terms and the particle mesh are ignored.
+ */
+int variationalSteps = 1000;        // Steps per propagated interval
+double periodicTolerance = 1e-12;   // |y(T) - y0|∞ relative to |y0|∞
+double periodicOrbitPeriod = 0.0;   // Result of the last findPeriodicOrbit()
+double periodicOrbitResidual = 0.0;
+
+struct VariationalState {
+    size_t n = 0;
+    size_t cols = 0;                 // 6n columns of Φ
+    std::vector<double> gm;          // G m_i
+    std::vector<double> x, v, a;     // 3n each, [3 i + c]
+    std::vector<double> stm;         // Φ, 6n × 6n row-major: δx rows, then δv rows
+    std::vector<double> stmAccel;    // J δx, 3n × 6n
+    std::vector<double> tidal;       // T_ij per pair i < j: xx, xy, xz, yy, yz, zz
+    bool forcesValid = false;        // a and tidal belong to x
+    
+    void resize(size_t bodyCount) {
+        n = bodyCount;
+        cols = 6 * n;
+        gm.resize(n);
+        x.resize(3 * n);
+        v.resize(3 * n);
+        a.resize(3 * n);
+        stm.resize(6 * n * cols);
+        stmAccel.resize(3 * n * cols);
+        tidal.resize(3 * n * (n - 1));
+    }
+};
+
+VariationalState variational;
+
+// Shooting scratch: y0, y(T), the (6n) × (6n + 1) Newton matrix and its V
+struct ShootingScratch {
+    std::vector<double> start, end, residual;
+    std::vector<double> matrix, basis, step;
+};
+ShootingScratch shooting;
+
+// Accelerations and tidal tensors at the current positions
+void variationalForces(VariationalState& s) {
+    if (s.forcesValid) return;
+    const double softeningSq = softeningLength * softeningLength;
+    std::fill(s.a.begin(), s.a.end(), 0.0);
+    double* t = s.tidal.data();
+    for (size_t i = 0; i < s.n; i++) {
+        for (size_t j = i + 1; j < s.n; j++, t += 6) {
+            double rx = s.x[3 * j] - s.x[3 * i];
+            double ry = s.x[3 * j + 1] - s.x[3 * i + 1];
+            double rz = s.x[3 * j + 2] - s.x[3 * i + 2];
+            double distSq = rx * rx + ry * ry + rz * rz + softeningSq;
+            double invDist = 1.0 / sqrt(distSq);
+            double invDist3 = invDist * invDist * invDist;
+            double invDist5 = invDist3 * invDist * invDist;
+            s.a[3 * i] += s.gm[j] * rx * invDist3;
+            s.a[3 * i + 1] += s.gm[j] * ry * invDist3;
+            s.a[3 * i + 2] += s.gm[j] * rz * invDist3;
+            s.a[3 * j] -= s.gm[i] * rx * invDist3;
+            s.a[3 * j + 1] -= s.gm[i] * ry * invDist3;
+            s.a[3 * j + 2] -= s.gm[i] * rz * invDist3;
+            t[0] = invDist3 - 3.0 * rx * rx * invDist5;
+            t[1] = -3.0 * rx * ry * invDist5;
+            t[2] = -3.0 * rx * rz * invDist5;
+            t[3] = invDist3 - 3.0 * ry * ry * invDist5;
+            t[4] = -3.0 * ry * rz * invDist5;
+            t[5] = invDist3 - 3.0 * rz * rz * invDist5;
+        }
+    }
+    s.forcesValid = true;
+}
+
+// v += k a,  δv += k J δx  (all columns)
+void variationalKick(VariationalState& s, double k) {
+    variationalForces(s);
+    for (size_t i = 0; i < 3 * s.n; i++) {
+        s.v[i] += k * s.a[i];
+    }
+    
+    const size_t cols = s.cols;
+    std::fill(s.stmAccel.begin(), s.stmAccel.end(), 0.0);
+    const double* t = s.tidal.data();
+    for (size_t i = 0; i < s.n; i++) {
+        for (size_t j = i + 1; j < s.n; j++, t += 6) {
+            const double* xi = s.stm.data() + 3 * i * cols;
+            const double* xj = s.stm.data() + 3 * j * cols;
+            double* ai = s.stmAccel.data() + 3 * i * cols;
+            double* aj = s.stmAccel.data() + 3 * j * cols;
+            const double gi = s.gm[i], gj = s.gm[j];
+            const double txx = t[0], txy = t[1], txz = t[2], tyy = t[3], tyz = t[4], tzz = t[5];
+            for (size_t c = 0; c < cols; c++) {
+                double dx = xj[c] - xi[c];
+                double dy = xj[cols + c] - xi[cols + c];
+                double dz = xj[2 * cols + c] - xi[2 * cols + c];
+                double wx = txx * dx + txy * dy + txz * dz;
+                double wy = txy * dx + tyy * dy + tyz * dz;
+                double wz = txz * dx + tyz * dy + tzz * dz;
+                ai[c] += gj * wx;
+                ai[cols + c] += gj * wy;
+                ai[2 * cols + c] += gj * wz;
+                aj[c] -= gi * wx;
+                aj[cols + c] -= gi * wy;
+                aj[2 * cols + c] -= gi * wz;
+            }
+        }
+    }
+    double* dv = s.stm.data() + 3 * s.n * cols;
+    for (size_t i = 0; i < 3 * s.n * cols; i++) {
+        dv[i] += k * s.stmAccel[i];
+    }
+}
+
+// x += h v,  δx += h δv
+void variationalDrift(VariationalState& s, double h) {
+    for (size_t i = 0; i < 3 * s.n; i++) {
+        s.x[i] += h * s.v[i];
+    }
+    const size_t half = 3 * s.n * s.cols;
+    double* dx = s.stm.data();
+    const double* dv = dx + half;
+    for (size_t i = 0; i < half; i++) {
+        dx[i] += h * dv[i];
+    }
+    s.forcesValid = false;
+}
+
+// Load y (6n values) with Φ = I
+void beginVariational(VariationalState& s, const double* y) {
+    std::copy(y, y + 3 * s.n, s.x.begin());
+    std::copy(y + 3 * s.n, y + 6 * s.n, s.v.begin());
+    std::fill(s.stm.begin(), s.stm.end(), 0.0);
+    for (size_t i = 0; i < s.cols; i++) {
+        s.stm[i * s.cols + i] = 1.0;
+    }
+    s.forcesValid = false;
+}
+
+// Advance state and Φ by duration in `steps` 6th-order steps
+void propagateVariational(VariationalState& s, double duration, int steps) {
+    const double cbrt2 = cbrt(2.0);
+    const double fifthRoot2 = pow(2.0, 0.2);
+    const double w1 = 1.0 / (2.0 - cbrt2), w0 = 1.0 - 2.0 * w1;
+    const double z1 = 1.0 / (2.0 - fifthRoot2), z0 = 1.0 - 2.0 * z1;
+    const double stages[9] = { z1 * w1, z1 * w0, z1 * w1,
+                               z0 * w1, z0 * w0, z0 * w1,
+                               z1 * w1, z1 * w0, z1 * w1 };
+    const double h = duration / steps;
+    for (int step = 0; step < steps; step++) {
+        for (double stage : stages) {
+            variationalKick(s, 0.5 * stage * h);
+            variationalDrift(s, stage * h);
+            variationalKick(s, 0.5 * stage * h);
+        }
+    }
+}
+
+/**
+ * Minimum-norm solution of A x = b for an m × n row-major A (n >= m) by
+ * one-sided Jacobi SVD: columns of A are rotated until orthogonal
+ * (A V = U Σ), then x = Σ_k V_k (U_k·b) / σ_k over σ_k > cutoff σ_max.
+ * A is overwritten; V needs n × n doubles.
+ */
+void minimumNormSolve(double* A, size_t m, size_t n, const double* b, double* V, double* x, double cutoff) {
+    std::fill(V, V + n * n, 0.0);
+    for (size_t i = 0; i < n; i++) V[i * n + i] = 1.0;
+    for (int sweep = 0; sweep < 60; sweep++) {
+        bool rotated = false;
+        for (size_t p = 0; p + 1 < n; p++) {
+            for (size_t q = p + 1; q < n; q++) {
+                double alpha = 0.0, beta = 0.0, gamma = 0.0;
+                for (size_t i = 0; i < m; i++) {
+                    alpha += A[i * n + p] * A[i * n + p];
+                    beta += A[i * n + q] * A[i * n + q];
+                    gamma += A[i * n + p] * A[i * n + q];
+                }
+                if (fabs(gamma) <= 1e-15 * sqrt(alpha * beta) || gamma == 0.0) continue;
+                rotated = true;
+                double zeta = (beta - alpha) / (2.0 * gamma);
+                double t = (zeta >= 0.0 ? 1.0 : -1.0) / (fabs(zeta) + sqrt(1.0 + zeta * zeta));
+                double c = 1.0 / sqrt(1.0 + t * t);
+                double s = c * t;
+                for (size_t i = 0; i < m; i++) {
+                    double ap = A[i * n + p], aq = A[i * n + q];
+                    A[i * n + p] = c * ap - s * aq;
+                    A[i * n + q] = s * ap + c * aq;
+                }
+                for (size_t i = 0; i < n; i++) {
+                    double vp = V[i * n + p], vq = V[i * n + q];
+                    V[i * n + p] = c * vp - s * vq;
+                    V[i * n + q] = s * vp + c * vq;
+                }
+            }
+        }
+        if (!rotated) break;
+    }
+    
+    double sigmaMax = 0.0;
+    for (size_t k = 0; k < n; k++) {
+        double normSq = 0.0;
+        for (size_t i = 0; i < m; i++) normSq += A[i * n + k] * A[i * n + k];
+        sigmaMax = std::max(sigmaMax, sqrt(normSq));
+    }
+    std::fill(x, x + n, 0.0);
+    for (size_t k = 0; k < n; k++) {
+        double normSq = 0.0, projection = 0.0;
+        for (size_t i = 0; i < m; i++) {
+            normSq += A[i * n + k] * A[i * n + k];
+            projection += A[i * n + k] * b[i];
+        }
+        if (sqrt(normSq) <= cutoff * sigmaMax) continue;
+        // U_k·b / σ_k = (A V)_k·b / σ_k²
+        double weight = projection / normSq;
+        for (size_t i = 0; i < n; i++) {
+            x[i] += V[i * n + k] * weight;
+        }
+    }
+}
+
+// |y(T) - y0|∞ / |y0|∞ for the propagated state in `variational`
+double shootingResidual(const std::vector<double>& start, std::vector<double>& residual) {
+    const size_t half = 3 * variational.n;
+    double scale = 0.0, worst = 0.0;
+    for (size_t i = 0; i < 2 * half; i++) {
+        double end = i < half ? variational.x[i] : variational.v[i - half];
+        residual[i] = end - start[i];
+        scale = std::max(scale, fabs(start[i]));
+        worst = std::max(worst, fabs(residual[i]));
+    }
+    return scale > 0.0 ? worst / scale : worst;
+}
+
+/**
+ * Newton shooting from the current bodies (see PERIODIC ORBITS). On
+ * success the bodies are replaced by the refined initial state (barycentre
+ * kept in place, at rest) and the iteration count is returned; otherwise
+ * they are left untouched and -1 is returned.
+ */
+int refinePeriodicOrbit(double periodGuess, int maxIterations) {
+    const size_t n = bodies.size();
+    if (n < 2 || periodGuess <= 0.0 || variationalSteps < 1) return -1;
+    VariationalState& s = variational;
+    s.resize(n);
+    const size_t dim = 6 * n;
+    shooting.start.resize(dim);
+    shooting.end.resize(dim);
+    shooting.residual.resize(dim);
+    shooting.matrix.resize(dim * (dim + 1));
+    shooting.basis.resize((dim + 1) * (dim + 1));
+    shooting.step.resize(dim + 1);
+    
+    // Barycentric frame: a drifting centre of mass is never periodic
+    double totalMass = 0.0, cm[3] = {}, cmVel[3] = {};
+    for (const auto& b : bodies) {
+        totalMass += b.mass;
+        cm[0] += b.mass * b.x;
+        cm[1] += b.mass * b.y;
+        cm[2] += b.mass * b.z;
+        cmVel[0] += b.mass * b.vx;
+        cmVel[1] += b.mass * b.vy;
+        cmVel[2] += b.mass * b.vz;
+    }
+    if (totalMass <= 0.0) return -1;
+    for (int c = 0; c < 3; c++) {
+        cm[c] /= totalMass;
+        cmVel[c] /= totalMass;
+    }
+    std::vector<double>& y = shooting.start;
+    for (size_t i = 0; i < n; i++) {
+        const Body& b = bodies[i];
+        const double pos[3] = { b.x, b.y, b.z };
+        const double vel[3] = { b.vx, b.vy, b.vz };
+        for (int c = 0; c < 3; c++) {
+            y[3 * i + c] = pos[c] - cm[c];
+            y[3 * n + 3 * i + c] = vel[c] - cmVel[c];
+        }
+        s.gm[i] = G * b.mass;
+    }
+    
+    double period = periodGuess;
+    for (int iteration = 0; iteration <= maxIterations; iteration++) {
+        beginVariational(s, y.data());
+        propagateVariational(s, period, variationalSteps);
+        periodicOrbitResidual = shootingResidual(y, shooting.residual);
+        if (!std::isfinite(periodicOrbitResidual)) return -1;
+        if (periodicOrbitResidual <= periodicTolerance) {
+            periodicOrbitPeriod = period;
+            for (size_t i = 0; i < n; i++) {
+                Body& b = bodies[i];
+                b.x = y[3 * i] + cm[0];
+                b.y = y[3 * i + 1] + cm[1];
+                b.z = y[3 * i + 2] + cm[2];
+                b.vx = y[3 * n + 3 * i];
+                b.vy = y[3 * n + 3 * i + 1];
+                b.vz = y[3 * n + 3 * i + 2];
+            }
+            return iteration;
+        }
+        if (iteration == maxIterations) break;
+        
+        // [Φ - I | ẏ(T)], with ẏ(T) = (v, a) at the end state
+        variationalForces(s);
+        double* M = shooting.matrix.data();
+        for (size_t r = 0; r < dim; r++) {
+            for (size_t c = 0; c < dim; c++) {
+                M[r * (dim + 1) + c] = s.stm[r * dim + c] - (r == c ? 1.0 : 0.0);
+            }
+            M[r * (dim + 1) + dim] = r < 3 * n ? s.v[r] : s.a[r - 3 * n];
+            shooting.residual[r] = -shooting.residual[r];
+        }
+        minimumNormSolve(M, dim, dim + 1, shooting.residual.data(), shooting.basis.data(),
+                         shooting.step.data(), 1e-10);
+        for (size_t i = 0; i < dim; i++) {
+            y[i] += shooting.step[i];
+        }
+        period += shooting.step[dim];
+        if (period <= 0.0) return -1;
+    }
+    periodicOrbitPeriod = period;
+    return -1;
+}
+
+/**
+ * NASA GAME MODE: Threat Assessment and Mission Evaluation
+ * Monitors asteroid trajectory and evaluates mission status
+ */
+void evaluateMissionStatus() {
+    if (gameMode != GAME_MODE_ACTIVE || missionState == MISSION_SUCCESS || missionState == MISSION_FAILURE) {
+        return;
+    }
+    PROFILE_PHASE(PHASE_MISSION);
+    
+    // Update mission time
+    missionTime += dt * timeScale;
+    
+    // Check if bodies still exist
+    const int earth = bodyHandleSlot(earthBody);
+    const int asteroid = bodyHandleSlot(asteroidBody);
+    if (earth < 0 || asteroid < 0) {
+        return;
+    }
+    
+    // Closest Earth-asteroid distance during the step, not just at its end,
+    // so a fast asteroid cannot tunnel through Earth between samples
+    double distance;
+    if (stepStartValid) {
+        double sAtMin;
+        distance = closestSeparationInStep(asteroid, earth, sAtMin);
+    } else {
+        double dx = bodies[asteroid].x - bodies[earth].x;
+        double dy = bodies[asteroid].y - bodies[earth].y;
+        double dz = bodies[asteroid].z - bodies[earth].z;
+        distance = sqrt(dx * dx + dy * dy + dz * dz);
+    }
+    
+    // Track closest approach
+    if (distance < closestApproach) {
+        closestApproach = distance;
+    }
+    
+    // Check for collision
+    if (distance < threatRadius) {
+        missionState = MISSION_FAILURE;
+        printf("MISSION FAILED: Asteroid impact! Distance: %.2f km\n", distance);
+        return;
+    }
+    
+    // Check for close approach warning
+    if (distance < threatRadius * 3.0 && missionState == MISSION_RUNNING) {
+        missionState = MISSION_WARNING;
+    }
+    
+    // Check time limit
+    if (missionTime > timeLimit) {
+        if (closestApproach > threatRadius * safetyMargin) {
+            missionState = MISSION_SUCCESS;
+            missionScore = (int)(1000.0 * (closestApproach / (threatRadius * safetyMargin)) * 
+                                 (1.0 - deltaVUsed / deltaVBudget) * 
+                                 (1.0 - missionTime / timeLimit));
+            printf("MISSION SUCCESS! Closest approach: %.2f km, Score: %d\n", closestApproach, missionScore);
+        } else {
+            missionState = MISSION_FAILURE;
+            printf("MISSION FAILED: Asteroid too close (%.2f km)\n", closestApproach);
+        }
+    }
+}
+
+/**
+ * TEST PARTICLES: massless tracers for belts and debris fields
+ * 
+ * Test particles feel the gravity of every body but exert none, so they
+ * live in their own structure-of-arrays store instead of `bodies` and cost
+ * O(N_bodies × N_particles) per step instead of joining the O(N²) sum.
+ * 
+ * They are advanced after the bodies with kick-drift-kick leapfrog:
+ *   v += a(x; bodies at t) h/2,  x += v h,  v += a(x; bodies at t + h) h/2
+ * The closing acceleration is kept for the next step's opening kick as long
+ * as the bodies are still where that step left them (testParticleSources).
+ * The acceleration pass walks the particles in tiles with the bodies
+ * outside and the particle index innermost, so it vectorizes. With
+ * collisions on, particles that end a step inside a body are absorbed.
+ */
+struct TestParticles {
+    std::vector<double> x, y, z;
+    std::vector<double> vx, vy, vz;
+    std::vector<double> ax, ay, az;
+    
+    size_t size() const { return x.size(); }
+    
+    void push(double px, double py, double pz, double pvx, double pvy, double pvz) {
+        x.push_back(px);
+        y.push_back(py);
+        z.push_back(pz);
+        vx.push_back(pvx);
+        vy.push_back(pvy);
+        vz.push_back(pvz);
+        ax.push_back(0.0);
+        ay.push_back(0.0);
+        az.push_back(0.0);
+    }
+    
+    // O(1) removal; moves the last particle into slot i
+    void swapRemove(size_t i) {
+        std::vector<double>* fields[] = {&x, &y, &z, &vx, &vy, &vz, &ax, &ay, &az};
+        for (std::vector<double>* field : fields) {
+            (*field)[i] = field->back();
+            field->pop_back();
+        }
+    }
+    
+    void clear() {
+        std::vector<double>* fields[] = {&x, &y, &z, &vx, &vy, &vz, &ax, &ay, &az};
+        for (std::vector<double>* field : fields) {
+            field->clear();
+        }
+    }
+};
+
+const size_t TEST_PARTICLE_TILE = 256;   // Particles per tile of the acceleration pass
+
+TestParticles testParticles;
+TestParticles initialTestParticles;        // Restored by reset()
+std::vector<Body> testParticleSources;     // Bodies the cached accelerations belong to
+bool testParticleAccelValid = false;       // Cleared when particles are added or edited
+double testParticleG = 0.0;
+double testParticleSoftening = 0.0;
+
+// Accelerations of all test particles from the current bodies
+void testParticleAccelerations() {
+    PROFILE_PHASE(PHASE_FORCES);
+    const size_t n = testParticles.size();
+    const Body* b = bodies.data();
+    const size_t nb = bodies.size();
+    const double softeningSq = softeningLength * softeningLength;
+    const double* x = testParticles.x.data();
+    const double* y = testParticles.y.data();
+    const double* z = testParticles.z.data();
+    double* ax = testParticles.ax.data();
+    double* ay = testParticles.ay.data();
+    double* az = testParticles.az.data();
+    PROFILE_COUNT(pairInteractions, static_cast<double>(n) * nb);
+    
+    for (size_t start = 0; start < n; start += TEST_PARTICLE_TILE) {
+        const size_t count = std::min(n - start, TEST_PARTICLE_TILE);
+        // Local tile: no aliasing between the position and acceleration arrays
+        double tileX[TEST_PARTICLE_TILE] = {};
+        double tileY[TEST_PARTICLE_TILE] = {};
+        double tileZ[TEST_PARTICLE_TILE] = {};
+        const double* px = x + start;
+        const double* py = y + start;
+        const double* pz = z + start;
+        for (size_t j = 0; j < nb; j++) {
+            const double bx = b[j].x, by = b[j].y, bz = b[j].z;
+            const double gm = G * b[j].mass;
+            for (size_t k = 0; k < count; k++) {
+                double dx = bx - px[k];
+                double dy = by - py[k];
+                double dz = bz - pz[k];
+                double distSq = dx * dx + dy * dy + dz * dz + softeningSq;
+                double invDist = distSq > 0.0 ? 1.0 / sqrt(distSq) : 0.0;
+                double scale = gm * invDist * invDist * invDist;
+                tileX[k] += scale * dx;
+                tileY[k] += scale * dy;
+                tileZ[k] += scale * dz;
+            }
+        }
+        std::copy(tileX, tileX + count, ax + start);
+        std::copy(tileY, tileY + count, ay + start);
+        std::copy(tileZ, tileZ + count, az + start);
+    }
+}
+
+// True while the cached accelerations still describe the current bodies
+bool testParticleSourcesValid() {
+    if (!testParticleAccelValid || testParticleSources.size() != bodies.size() ||
+        testParticleG != G || testParticleSoftening != softeningLength) {
+        return false;
+    }
+    for (size_t i = 0; i < bodies.size(); i++) {
+        const Body& a = bodies[i];
+        const Body& c = testParticleSources[i];
+        if (a.x != c.x || a.y != c.y || a.z != c.z || a.mass != c.mass) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void captureTestParticleSources() {
+    testParticleSources.assign(bodies.begin(), bodies.end());
+    testParticleG = G;
+    testParticleSoftening = softeningLength;
+    testParticleAccelValid = true;
+}
+
+// Before the bodies move: make sure the opening kick has a(t)
+void beginTestParticleStep() {
+    if (testParticles.size() == 0 || testParticleSourcesValid()) return;
+    testParticleAccelerations();
+    captureTestParticleSources();
+}
+
+// After the bodies moved by h: kick, drift, re-evaluate, kick
+void advanceTestParticles() {
+    const size_t n = testParticles.size();
+    if (n == 0) return;
+    PROFILE_PHASE(PHASE_INTEGRATION);
+    const double h = dt * timeScale;
+    TestParticles& p = testParticles;
+    for (size_t k = 0; k < n; k++) {
+        p.vx[k] += p.ax[k] * h * 0.5;
+        p.vy[k] += p.ay[k] * h * 0.5;
+        p.vz[k] += p.az[k] * h * 0.5;
+        p.x[k] += p.vx[k] * h;
+        p.y[k] += p.vy[k] * h;
+        p.z[k] += p.vz[k] * h;
+    }
+    testParticleAccelerations();
+    for (size_t k = 0; k < n; k++) {
+        p.vx[k] += p.ax[k] * h * 0.5;
+        p.vy[k] += p.ay[k] * h * 0.5;
+        p.vz[k] += p.az[k] * h * 0.5;
+    }
+    captureTestParticleSources();
+    
+    if (enableCollisions) {
+        PROFILE_PHASE(PHASE_COLLISIONS);
+        for (size_t k = p.size(); k-- > 0;) {
+            for (const auto& body : bodies) {
+                double dx = p.x[k] - body.x, dy = p.y[k] - body.y, dz = p.z[k] - body.z;
+                if (dx * dx + dy * dy + dz * dz < body.radius * body.radius) {
+                    p.swapRemove(k);
+                    break;
+                }
+            }
+        }
+    }
+}
+
+// Scene changes drop the particles along with their initial copy
+void discardTestParticles() {
+    testParticles.clear();
+    initialTestParticles.clear();
+    testParticleAccelValid = false;
+}
+
+/**
+ * BODY ORDER: space-filling-curve sorting of the body store for locality
+ * 
+ * Insertion order, and the reshuffling merges cause, scatters spatial
+ * neighbours across the store. Once N is large, the particle-mesh deposit
+ * and interpolation, the mixed-precision kernel's 64-body tiles and the
+ * k-d tree build then touch memory at random. Every bodyOrderCheckInterval
+ * steps the disorder of the store is measured. It is the fraction of
+ * neighbouring slots whose curve keys step backwards at a coarse level of
+ * about 8 bodies per cell: 0 right after a sort, about 1/2 for a random
+ * order. Past bodyOrderThreshold, the bodies are sorted by their 63-bit
+ * Hilbert (or Morton) key over the bounding cube. Every per-body array and
+ * stored slot (events, samplers, mission bodies) is permuted with them,
+ * and external indices go through bodySlots/bodyRanks.
+ */
+enum BodyOrdering {
+    BODY_ORDER_NONE,
+    BODY_ORDER_MORTON,
+    BODY_ORDER_HILBERT
+};
+
+int bodyOrdering = BODY_ORDER_HILBERT;
+size_t bodyOrderMinBodies = 1024;   // Smaller scenes stay cache-resident anyway
+int bodyOrderCheckInterval = 16;    // Steps between disorder checks
+double bodyOrderThreshold = 0.2;    // Disorder that triggers a sort
+double bodyOrderDisorder = 0.0;     // Last measured
+int stepsSinceOrderCheck = 0;
+long bodyReorders = 0;
+
+const int CURVE_BITS = 21;          // Per axis, for 63-bit keys
+
+struct BodyOrderScratch {
+    std::vector<std::pair<uint64_t, uint32_t>> keys;   // (key, old slot), sorted
+    std::vector<uint32_t> newSlots;                      // Old slot -> new slot
+    std::vector<Body> bodies;
+    std::vector<HermiteDerivatives> derivatives;
+    std::vector<uint32_t> handles;
+};
+BodyOrderScratch bodyOrderScratch;
+
+// Low 21 bits of v moved to every third bit
+inline uint64_t spreadBits3(uint64_t v) {
+    v &= 0x1fffff;
+    v = (v | v << 32) & 0x1f00000000ffffull;
+    v = (v | v << 16) & 0x1f0000ff0000ffull;
+    v = (v | v << 8) & 0x100f00f00f00f00full;
+    v = (v | v << 4) & 0x10c30c30c30c30c3ull;
+    v = (v | v << 2) & 0x1249249249249249ull;
+    return v;
+}
+
+// Key of cell (x, y, z) on a 2^bits grid. Hilbert: Skilling's transpose
+// ("Programming the Hilbert curve", 2004), then interleaved like Morton
+uint64_t curveKey(uint32_t x, uint32_t y, uint32_t z, int bits, int ordering) {
+    if (ordering == BODY_ORDER_HILBERT) {
+        uint32_t X[3] = { x, y, z };
+        for (uint32_t q = 1u << (bits - 1); q > 1; q >>= 1) {
+            uint32_t p = q - 1;
+            for (int i = 0; i < 3; i++) {
+                if (X[i] & q) {
+                    X[0] ^= p;
+                } else {
+                    uint32_t t = (X[0] ^ X[i]) & p;
+                    X[0] ^= t;
+                    X[i] ^= t;
+                }
+            }
+        }
+        X[1] ^= X[0];
+        X[2] ^= X[1];
+        uint32_t t = 0;
+        for (uint32_t q = 1u << (bits - 1); q > 1; q >>= 1) {
+            if (X[2] & q) t ^= q - 1;
+        }
+        x = X[0] ^ t;
+        y = X[1] ^ t;
+        z = X[2] ^ t;
+    }
+    return spreadBits3(x) << 2 | spreadBits3(y) << 1 | spreadBits3(z);
+}
+
+// Bounding cube of the bodies mapped onto a 2^bits grid
+struct CurveGrid {
+    double minX, minY, minZ;
+    double scale;   // Cells per unit length
+    int bits;
+};
+
+CurveGrid curveGrid(int bits) {
+    double minX = INFINITY, minY = INFINITY, minZ = INFINITY;
+    double maxX = -INFINITY, maxY = -INFINITY, maxZ = -INFINITY;
+    for (const auto& b : bodies) {
+        minX = std::min(minX, b.x); maxX = std::max(maxX, b.x);
+        minY = std::min(minY, b.y); maxY = std::max(maxY, b.y);
+        minZ = std::min(minZ, b.z); maxZ = std::max(maxZ, b.z);
+    }
+    double extent = std::max(maxX - minX, std::max(maxY - minY, maxZ - minZ));
+    double scale = extent > 0.0 ? std::ldexp(1.0, bits) / extent : 0.0;
+    return { minX, minY, minZ, scale, bits };
+}
+
+inline uint32_t curveCell(double v, double min, const CurveGrid& grid) {
+    double cell = (v - min) * grid.scale;
+    const double top = std::ldexp(1.0, grid.bits) - 1.0;
+    return static_cast<uint32_t>(cell > 0.0 ? std::min(cell, top) : 0.0);   // NaN -> 0
+}
+
+inline uint64_t bodyCurveKey(const Body& b, const CurveGrid& grid) {
+    return curveKey(curveCell(b.x, grid.minX, grid), curveCell(b.y, grid.minY, grid),
+                    curveCell(b.z, grid.minZ, grid), grid.bits, bodyOrdering);
+}
+
+double measureBodyDisorder() {
+    const size_t n = bodies.size();
+    if (n < 2 || bodyOrdering == BODY_ORDER_NONE) return 0.0;
+    int bits = static_cast<int>(ceil(log2(n / 8.0) / 3.0));
+    CurveGrid grid = curveGrid(std::max(1, std::min(bits, CURVE_BITS)));
+    size_t descents = 0;
+    uint64_t previous = bodyCurveKey(bodies[0], grid);
+    for (size_t i = 1; i < n; i++) {
+        uint64_t key = bodyCurveKey(bodies[i], grid);
+        if (key < previous) descents++;
+        previous = key;
+    }
+    return static_cast<double>(descents) / (n - 1);
+}
+
+// values[k] = values[old slot of k], for arrays kept in step with bodies
+template <typename T>
+void permuteBodyArray(std::vector<T>& values, std::vector<T>& scratch) {
+    const auto& keys = bodyOrderScratch.keys;
+    if (values.size() != keys.size()) return;
+    scratch.resize(keys.size());
+    for (size_t k = 0; k < keys.size(); k++) {
+        scratch[k] = values[keys[k].second];
+    }
+    values.swap(scratch);
+}
+
+void sortBodies() {
+    const size_t n = bodies.size();
+    if (n < 2 || bodyOrdering == BODY_ORDER_NONE) return;
+    BodyOrderScratch& s = bodyOrderScratch;
+    CurveGrid grid = curveGrid(CURVE_BITS);
+    s.keys.resize(n);
+    for (size_t i = 0; i < n; i++) {
+        s.keys[i] = { bodyCurveKey(bodies[i], grid), static_cast<uint32_t>(i) };
+    }
+    std::sort(s.keys.begin(), s.keys.end());
+    s.newSlots.resize(n);
+    for (size_t k = 0; k < n; k++) {
+        s.newSlots[s.keys[k].second] = static_cast<uint32_t>(k);
+    }
+    
+    permuteBodyArray(bodies, s.bodies);
+    permuteBodyArray(previousBodies, s.bodies);
+    permuteBodyArray(stepStartBodies, s.bodies);
+    permuteBodyArray(testParticleSources, s.bodies);
+    permuteBodyArray(stepScratch.hermiteBodies, s.bodies);
+    permuteBodyArray(stepScratch.hermiteStart, s.derivatives);
+    extendBodyHandles();
+    permuteBodyArray(slotHandles, s.handles);
+    for (size_t k = 0; k < n; k++) {
+        bodyHandleEntries[slotHandles[k]].slot = static_cast<uint32_t>(k);
+    }
+    
+    auto remap = [&s, n](int& slot) {
+        if (slot >= 0 && static_cast<size_t>(slot) < n) slot = static_cast<int>(s.newSlots[slot]);
+    };
+    for (auto& event : eventDefinitions) {
+        remap(event.bodyA);
+        remap(event.bodyB);
+    }
+    for (auto& sampler : phaseSamplers) {
+        remap(sampler.body);
+        remap(sampler.reference);
+    }
+    remap(keplerStepPrimary);
+    
+    extendBodyOrder();
+    for (size_t index = 0; index < n; index++) {
+        bodySlots[index] = s.newSlots[bodySlots[index]];
+        bodyRanks[bodySlots[index]] = static_cast<uint32_t>(index);
+    }
+    spatialIndexDirty = true;
+    bodyOrderDisorder = 0.0;
+    stepsSinceOrderCheck = 0;
+    bodyReorders++;
+}
+
+// After eraseBody: references to the removed slot are retired, and those
+// to the slot that moved into its place follow the body
+void retargetBodyReferences(size_t removed, size_t moved) {
+    const int gone = static_cast<int>(removed);
+    auto follow = [gone, moved](int& slot) {
+        if (slot == static_cast<int>(moved)) slot = gone;
+    };
+    for (auto& event : eventDefinitions) {
+        if (event.bodyA == gone || event.bodyB == gone) event.active = false;
+        follow(event.bodyA);
+        follow(event.bodyB);
+    }
+    for (auto& sampler : phaseSamplers) {
+        if (sampler.body == gone || sampler.reference == gone) sampler.active = false;
+        follow(sampler.body);
+        follow(sampler.reference);
+    }
+    if (keplerStepPrimary == gone) keplerStepPrimary = -1;
+    follow(keplerStepPrimary);
+}
+
+// Start of every step: sort once the store has drifted out of curve order
+void maintainBodyOrder() {
+    if (bodyOrdering == BODY_ORDER_NONE || bodies.size() < bodyOrderMinBodies) return;
+    if (++stepsSinceOrderCheck < bodyOrderCheckInterval) return;
+    stepsSinceOrderCheck = 0;
+    bodyOrderDisorder = measureBodyDisorder();
+    if (bodyOrderDisorder > bodyOrderThreshold) {
+        sortBodies();
+    }
+}
+
+/**
+ * Longest step the hierarchy allows right now (0 = integrate normally).
+ * An isolated pair can jump any distance; with more secondaries the
+ * hierarchy is re-checked every keplerJumpFraction dynamical times. When
+ * something looks inside steps (events, the mission, swept collisions),
+ * a step spans less than half an orbit so it holds at most one minimum.
+ * Test particles and discrete collisions keep normal steps.
+ */
+double keplerJumpLimit() {
+    if (!keplerFastForward || testParticles.size() > 0 || (enableCollisions && !continuousCollisions)) {
+        return 0.0;
+    }
+    int p = findKeplerPrimary();
+    if (p < 0) return 0.0;
+    const Body& primary = bodies[p];
+    const bool isolated = bodies.size() == 2;
+    const bool inStep = needStepStart();
+    double limit = INFINITY;
+    for (size_t k = 0; k < bodies.size(); k++) {
+        if (static_cast<int>(k) == p) continue;
+        const Body& b = bodies[k];
+        double dx = b.x - primary.x, dy = b.y - primary.y, dz = b.z - primary.z;
+        double dvx = b.vx - primary.vx, dvy = b.vy - primary.vy, dvz = b.vz - primary.vz;
+        double r = sqrt(dx * dx + dy * dy + dz * dz);
+        double mu = G * (primary.mass + b.mass);
+        if (!isolated) {
+            limit = std::min(limit, keplerJumpFraction * sqrt(r * r * r / mu));
+        }
+        double alpha = 2.0 / r - (dvx * dvx + dvy * dvy + dvz * dvz) / mu;
+        if (inStep && alpha > 0.0) {
+            limit = std::min(limit, 0.45 * 2.0 * M_PI / (sqrt(mu) * alpha * sqrt(alpha)));
+        }
+    }
+    return limit;
+}
+
+void updateBodies() {
+    if (baselinePending) {
+        ensureDiagnostics();
+    }
+    maintainBodyOrder();
+    beginEventStep();
+    beginTestParticleStep();
+    {
+        PROFILE_PHASE(PHASE_INTEGRATION);
+        keplerStepPrimary = keplerFastForward ? findKeplerPrimary() : -1;
+        if (keplerStepPrimary >= 0 && !advanceKepler(keplerStepPrimary, dt * timeScale)) {
+            keplerStepPrimary = -1;
+        }
+        if (keplerStepPrimary < 0) {
+            switch (currentMethod) {
+                case METHOD_EULER:
+                    updateBodiesEuler();
+                    break;
+                case METHOD_VERLET:
+                    updateBodiesVerlet();
+                    break;
+                case METHOD_RK4:
+                    updateBodiesRK4();
+                    break;
+                case METHOD_RKF45:
+                    updateBodiesRKF45();
+                    break;
+                case METHOD_HERMITE:
+                    updateBodiesHermite();
+                    break;
+            }
+        }
+    }
+    advanceTestParticles();
+    detectEvents();
+    samplePhaseSpace();
+    simulationTime += dt * timeScale;
+    markDiagnosticsDirty();
+    sampleDrift();
+    evaluateMissionStatus();
+    finishPerfStep();
+}
+
+/**
+ * SPATIAL INDEX: implicit k-d tree over body positions for picking and
+ * range queries
+ * 
+ * Nodes are stored in tree order: the node for range [lo, hi) sits at
+ * mid = (lo + hi) / 2 and splits on its axis (largest extent of the range).
+ * The tree is rebuilt lazily, at most once per state change, by the first
+ * query that needs it, reusing the previous build's buffer and ordering.
+ */
+struct SpatialNode {
+    double x, y, z;
+    double pickRadius;   // Click tolerance for findBodyAtPosition
+    int body;            // Index into bodies
+    int axis;            // Split axis (0 = x, 1 = y, 2 = z)
+};
+
+std::vector<SpatialNode> spatialNodes;
+double spatialMaxPickRadius = 0.0;
+std::vector<std::pair<double, int>> spatialHeap;   // k-nearest scratch (max-heap)
+bool spatialMomentsValid = false;   // Monopole moments match the tree (see POTENTIAL MAPS)
+
+inline double nodeCoord(const SpatialNode& node, int axis) {
+    return axis == 0 ? node.x : (axis == 1 ? node.y : node.z);
+}
+
+const int SPATIAL_FORK_NODES = 4096;   // Subtrees at least this large become tasks
+
+// Builds [lo, hi); with a fork group, large right subtrees are handed to
+// other workers while this one carries on with the left
+void buildSpatialRange(int lo, int hi, TaskGroup* fork = nullptr) {
+    if (hi - lo <= 1) return;
+    
+    double minX = spatialNodes[lo].x, maxX = minX;
+    double minY = spatialNodes[lo].y, maxY = minY;
+    double minZ = spatialNodes[lo].z, maxZ = minZ;
+    for (int i = lo + 1; i < hi; i++) {
+        minX = std::min(minX, spatialNodes[i].x); maxX = std::max(maxX, spatialNodes[i].x);
+        minY = std::min(minY, spatialNodes[i].y); maxY = std::max(maxY, spatialNodes[i].y);
+        minZ = std::min(minZ, spatialNodes[i].z); maxZ = std::max(maxZ, spatialNodes[i].z);
+    }
+    double ex = maxX - minX, ey = maxY - minY, ez = maxZ - minZ;
+    int axis = (ex >= ey && ex >= ez) ? 0 : (ey >= ez ? 1 : 2);
+    
+    int mid = (lo + hi) / 2;
+    std::nth_element(spatialNodes.begin() + lo, spatialNodes.begin() + mid, spatialNodes.begin() + hi,
+                     [axis](const SpatialNode& a, const SpatialNode& b) {
+                         return nodeCoord(a, axis) < nodeCoord(b, axis);
+                     });
+    spatialNodes[mid].axis = axis;
+    if (fork && hi - mid - 1 >= SPATIAL_FORK_NODES) {
+        spawnTask(*fork, mid + 1, hi);
+    } else {
+        buildSpatialRange(mid + 1, hi, fork);
+    }
+    buildSpatialRange(lo, mid, fork);
+}
+
+void ensureSpatialIndex() {
+    if (!spatialIndexDirty && spatialNodes.size() == bodies.size()) return;
+    
+    // Same body count: refresh positions in the previous tree order, which
+    // is already close to sorted for a scene that moved by one step
+    if (spatialNodes.size() != bodies.size()) {
+        spatialNodes.resize(bodies.size());
+        for (size_t i = 0; i < bodies.size(); i++) {
+            spatialNodes[i].body = static_cast<int>(i);
+        }
+    }
+    spatialMaxPickRadius = 0.0;
+    for (auto& node : spatialNodes) {
+        const Body& body = bodies[node.body];
+        node.x = body.x;
+        node.y = body.y;
+        node.z = body.z;
+        node.pickRadius = body.radius * 1.5;   // 1.5x for easier clicking
+        node.axis = 0;
+        spatialMaxPickRadius = std::max(spatialMaxPickRadius, node.pickRadius);
+    }
+    const int count = static_cast<int>(spatialNodes.size());
+    if (count >= 2 * SPATIAL_FORK_NODES && activeWorkers() > 1) {
+        TaskGroup build;
+        build.run = [](void*, TaskGroup& group, size_t begin, size_t end) {
+            buildSpatialRange(static_cast<int>(begin), static_cast<int>(end), &group);
+        };
+        build.context = nullptr;
+        build.costs = nullptr;
+        buildSpatialRange(0, count, &build);
+        waitForGroup(build);
+    } else {
+        buildSpatialRange(0, count);
+    }
+    spatialIndexDirty = false;
+    spatialMomentsValid = false;
+}
+
+// Highest external body index whose 2D (x, y) pick disc contains the point
+void pickSpatialRange(int lo, int hi, double x, double y, int& best) {
+    if (lo >= hi) return;
+    int mid = (lo + hi) / 2;
+    const SpatialNode& node = spatialNodes[mid];
+    
+    double dx = node.x - x;
+    double dy = node.y - y;
+    if (bodyRank(node.body) > best && dx * dx + dy * dy <= node.pickRadius * node.pickRadius) {
+        best = bodyRank(node.body);
+    }
+    if (hi - lo == 1) return;
+    
+    // Picking ignores z, so z splits cannot prune
+    if (node.axis == 2) {
+        pickSpatialRange(lo, mid, x, y, best);
+        pickSpatialRange(mid + 1, hi, x, y, best);
+        return;
+    }
+    double diff = (node.axis == 0 ? x : y) - nodeCoord(node, node.axis);
+    if (diff <= spatialMaxPickRadius) pickSpatialRange(lo, mid, x, y, best);
+    if (diff >= -spatialMaxPickRadius) pickSpatialRange(mid + 1, hi, x, y, best);
+}
+
+void nearestSpatialRange(int lo, int hi, const double q[3], size_t k) {
+    if (lo >= hi) return;
+    int mid = (lo + hi) / 2;
+    const SpatialNode& node = spatialNodes[mid];
+    
+    double dx = node.x - q[0];
+    double dy = node.y - q[1];
+    double dz = node.z - q[2];
+    double dist2 = dx * dx + dy * dy + dz * dz;
+    if (spatialHeap.size() < k) {
+        spatialHeap.push_back({dist2, node.body});
+        std::push_heap(spatialHeap.begin(), spatialHeap.end());
+    } else if (dist2 < spatialHeap.front().first) {
+        std::pop_heap(spatialHeap.begin(), spatialHeap.end());
+        spatialHeap.back() = {dist2, node.body};
+        std::push_heap(spatialHeap.begin(), spatialHeap.end());
+    }
+    if (hi - lo == 1) return;
+    
+    // Near side first so the far side is usually pruned
+    double diff = q[node.axis] - nodeCoord(node, node.axis);
+    bool lowerFirst = diff < 0.0;
+    nearestSpatialRange(lowerFirst ? lo : mid + 1, lowerFirst ? mid : hi, q, k);
+    if (spatialHeap.size() < k || diff * diff < spatialHeap.front().first) {
+        nearestSpatialRange(lowerFirst ? mid + 1 : lo, lowerFirst ? hi : mid, q, k);
+    }
+}
+
+void radiusSpatialRange(int lo, int hi, const double q[3], double radius, int* out, int maxResults, int& found) {
+    if (lo >= hi) return;
+    int mid = (lo + hi) / 2;
+    const SpatialNode& node = spatialNodes[mid];
+    
+    double dx = node.x - q[0];
+    double dy = node.y - q[1];
+    double dz = node.z - q[2];
+    if (dx * dx + dy * dy + dz * dz <= radius * radius) {
+        if (found < maxResults) out[found] = bodyRank(node.body);
+        found++;
+    }
+    if (hi - lo == 1) return;
+    
+    double diff = q[node.axis] - nodeCoord(node, node.axis);
+    if (diff <= radius) radiusSpatialRange(lo, mid, q, radius, out, maxResults, found);
+    if (diff >= -radius) radiusSpatialRange(mid + 1, hi, q, radius, out, maxResults, found);
+}
+
+/**
+ * POTENTIAL MAPS: Φ (or the rotating-frame Φ_eff) sampled on a grid
+ * 
+ *   Φ(q) = -Σ G m_j / sqrt(|q - x_j|² + ε²)
+ *   Φ_eff(q) = Φ(q) - Ω² ((q_x - c_x)² + (q_y - c_y)²) / 2
+ * with c the barycentre, for zero-velocity curves and Hill regions.
+ * 
+ * The grid is evaluated in 16 × 16 tiles against a list of point sources,
+ * with the sources outside and the tile's points innermost, so the pass
+ * vectorizes across grid points. Small scenes use the bodies themselves.
+ * Larger scenes reuse the spatial index as a monopole tree: each k-d range
+ * caches its mass, centre of mass and radius, and each tile walks the tree
+ * once, taking a range as a point mass when its radius is below
+ * potentialTheta times its distance from the nearest point of the tile.
+ */
+struct SpatialMoment {
+    double mass;
+    double x, y, z;     // Centre of mass of the range
+    double radius;      // Bounds every body of the range around (x, y, z)
+};
+
+const int POTENTIAL_BLOCK = 16;               // Grid tile side
+const size_t POTENTIAL_TILE = POTENTIAL_BLOCK * POTENTIAL_BLOCK;
+const size_t POTENTIAL_TREE_THRESHOLD = 64;   // Bodies above which the tree is used
+double potentialTheta = 0.5;                  // Opening angle of the monopole tree
+
+std::vector<SpatialMoment> spatialMoments;    // Indexed like spatialNodes
+
+// Moments of range [lo, hi), stored at its node (mid)
+SpatialMoment buildMomentRange(int lo, int hi) {
+    int mid = (lo + hi) / 2;
+    const SpatialNode& node = spatialNodes[mid];
+    SpatialMoment ranges[2] = {};
+    int childCount = 0;
+    if (lo < mid) ranges[childCount++] = buildMomentRange(lo, mid);
+    if (mid + 1 < hi) ranges[childCount++] = buildMomentRange(mid + 1, hi);
+    
+    double m = bodies[node.body].mass;
+    SpatialMoment moment = { m, m * node.x, m * node.y, m * node.z, 0.0 };
+    for (int c = 0; c < childCount; c++) {
+        moment.mass += ranges[c].mass;
+        moment.x += ranges[c].mass * ranges[c].x;
+        moment.y += ranges[c].mass * ranges[c].y;
+        moment.z += ranges[c].mass * ranges[c].z;
+    }
+    if (moment.mass > 0.0) {
+        moment.x /= moment.mass;
+        moment.y /= moment.mass;
+        moment.z /= moment.mass;
+    } else {
+        moment.x = node.x;
+        moment.y = node.y;
+        moment.z = node.z;
+    }
+    
+    double dx = node.x - moment.x, dy = node.y - moment.y, dz = node.z - moment.z;
+    moment.radius = sqrt(dx * dx + dy * dy + dz * dz);
+    for (int c = 0; c < childCount; c++) {
+        dx = ranges[c].x - moment.x;
+        dy = ranges[c].y - moment.y;
+        dz = ranges[c].z - moment.z;
+        moment.radius = std::max(moment.radius, ranges[c].radius + sqrt(dx * dx + dy * dy + dz * dz));
+    }
+    spatialMoments[mid] = moment;
+    return moment;
+}
+
+void ensureSpatialMoments() {
+    ensureSpatialIndex();
+    if (spatialMomentsValid) return;
+    spatialMoments.resize(spatialNodes.size());
+    if (!spatialNodes.empty()) {
+        buildMomentRange(0, static_cast<int>(spatialNodes.size()));
+    }
+    spatialMomentsValid = true;
+}
+
+// Point source of an interaction list: position and G m
+struct PotentialSource {
+    double x, y, z, gm;
+};
+
+std::vector<PotentialSource> potentialSources;   // Direct list (small scenes)
+
+// Per-worker tile buffers, reused between maps
+struct PotentialScratch {
+    std::vector<PotentialSource> sources;   // Interaction list of the tile
+    std::vector<float> local;               // Tile-relative sources (SoA)
+};
+PotentialScratch potentialScratch[MAX_WORKERS];
+TaskCosts potentialMapCosts;
+
+/**
+ * Sources for a block of grid points within blockRadius of `centre`: a
+ * range far enough from the whole block (radius < θ (d - blockRadius))
+ * enters as its monopole, otherwise its node body enters directly and
+ * its children are visited.
+ */
+void collectPotentialSources(std::vector<PotentialSource>& sources, int lo, int hi, const double centre[3],
+                             double blockRadius, double theta) {
+    if (lo >= hi) return;
+    int mid = (lo + hi) / 2;
+    const SpatialMoment& moment = spatialMoments[mid];
+    double dx = moment.x - centre[0], dy = moment.y - centre[1], dz = moment.z - centre[2];
+    double dist = sqrt(dx * dx + dy * dy + dz * dz);
+    if (hi - lo > 1 && moment.radius < theta * (dist - blockRadius)) {
+        sources.push_back({ moment.x, moment.y, moment.z, G * moment.mass });
+        return;
+    }
+    const SpatialNode& node = spatialNodes[mid];
+    sources.push_back({ node.x, node.y, node.z, G * bodies[node.body].mass });
+    collectPotentialSources(sources, lo, mid, centre, blockRadius, theta);
+    collectPotentialSources(sources, mid + 1, hi, centre, blockRadius, theta);
+}
+
+/**
+ * Φ of the current sources at up to POTENTIAL_TILE points in the plane z.
+ * Offsets from the tile centre are small, so the pair terms run in float
+ * (the map is float anyway) at twice the SIMD width of double.
+ */
+void potentialTile(const std::vector<PotentialSource>& sources, std::vector<float>& local,
+                   const double* px, const double* py, const double centre[3], size_t count, double* phi) {
+    const size_t ns = sources.size();
+    local.resize(4 * ns);
+    float* sx = local.data();
+    float* sy = sx + ns;
+    float* planeSq = sy + ns;
+    float* gm = planeSq + ns;
+    const double softeningSq = softeningLength * softeningLength;
+    for (size_t j = 0; j < ns; j++) {
+        const PotentialSource& src = sources[j];
+        double ez = src.z - centre[2];
+        sx[j] = static_cast<float>(src.x - centre[0]);
+        sy[j] = static_cast<float>(src.y - centre[1]);
+        planeSq[j] = static_cast<float>(ez * ez + softeningSq);
+        gm[j] = static_cast<float>(src.gm);
+    }
+    
+    float qx[POTENTIAL_TILE], qy[POTENTIAL_TILE], sum[POTENTIAL_TILE] = {};
+    for (size_t k = 0; k < count; k++) {
+        qx[k] = static_cast<float>(px[k] - centre[0]);
+        qy[k] = static_cast<float>(py[k] - centre[1]);
+    }
+    for (size_t j = 0; j < ns; j++) {
+        const float x = sx[j], y = sy[j], p = planeSq[j], m = gm[j];
+        for (size_t k = 0; k < count; k++) {
+            float ex = x - qx[k];
+            float ey = y - qy[k];
+            float distSq = ex * ex + ey * ey + p;
+            sum[k] -= distSq > 0.0f ? m / sqrtf(distSq) : 0.0f;
+        }
+    }
+    for (size_t k = 0; k < count; k++) {
+        phi[k] = sum[k];
+    }
+}
+
+// Rigid rotation rate about the barycentre's z axis: Ω = L_z / I_z
+double systemRotationRate() {
+    double totalMass = 0.0, cx = 0.0, cy = 0.0, cvx = 0.0, cvy = 0.0;
+    for (const auto& b : bodies) {
+        totalMass += b.mass;
+        cx += b.mass * b.x;
+        cy += b.mass * b.y;
+        cvx += b.mass * b.vx;
+        cvy += b.mass * b.vy;
+    }
+    if (totalMass <= 0.0) return 0.0;
+    cx /= totalMass;
+    cy /= totalMass;
+    cvx /= totalMass;
+    cvy /= totalMass;
+    double angularMomentum = 0.0, inertia = 0.0;
+    for (const auto& b : bodies) {
+        double x = b.x - cx, y = b.y - cy;
+        angularMomentum += b.mass * (x * (b.vy - cvy) - y * (b.vx - cvx));
+        inertia += b.mass * (x * x + y * y);
+    }
+    return inertia > 0.0 ? angularMomentum / inertia : 0.0;
+}
+
+/**
+ * Fill out[row * width + column] with Φ (omega = 0) or Φ_eff at the cell
+ * centres of the [xMin, xMax] × [yMin, yMax] rectangle in the plane z.
+ * The grid is walked in POTENTIAL_BLOCK² tiles; large scenes collect one
+ * interaction list per tile. Rows of tiles are spread over the workers.
+ */
+void potentialMap(float* out, int width, int height, double xMin, double yMin,
+                  double xMax, double yMax, double z, double omega) {
+    const double dx = (xMax - xMin) / width;
+    const double dy = (yMax - yMin) / height;
+    const bool useTree = bodies.size() > POTENTIAL_TREE_THRESHOLD;
+    if (useTree) {
+        ensureSpatialMoments();
+    } else {
+        potentialSources.clear();
+        for (const auto& b : bodies) {
+            potentialSources.push_back({ b.x, b.y, b.z, G * b.mass });
+        }
+    }
+    
+    double cx = 0.0, cy = 0.0;
+    if (omega != 0.0) {
+        double totalMass = 0.0;
+        for (const auto& b : bodies) {
+            totalMass += b.mass;
+            cx += b.mass * b.x;
+            cy += b.mass * b.y;
+        }
+        if (totalMass > 0.0) {
+            cx /= totalMass;
+            cy /= totalMass;
+        }
+    }
+    const double halfOmegaSq = 0.5 * omega * omega;
+    
+    const size_t tileRows = (height + POTENTIAL_BLOCK - 1) / POTENTIAL_BLOCK;
+    parallelFor(potentialMapCosts, tileRows, 1, [&](size_t tileBegin, size_t tileEnd) {
+        PotentialScratch& scratch = potentialScratch[currentWorker];
+        const std::vector<PotentialSource>& sources = useTree ? scratch.sources : potentialSources;
+        double px[POTENTIAL_TILE], py[POTENTIAL_TILE], phi[POTENTIAL_TILE];
+        for (size_t tile = tileBegin; tile < tileEnd; tile++) {
+            const int row0 = static_cast<int>(tile) * POTENTIAL_BLOCK;
+            const int rows = std::min(height - row0, POTENTIAL_BLOCK);
+            for (int col0 = 0; col0 < width; col0 += POTENTIAL_BLOCK) {
+                const int cols = std::min(width - col0, POTENTIAL_BLOCK);
+                size_t count = 0;
+                for (int r = 0; r < rows; r++) {
+                    for (int c = 0; c < cols; c++) {
+                        px[count] = xMin + (col0 + c + 0.5) * dx;
+                        py[count] = yMin + (row0 + r + 0.5) * dy;
+                        count++;
+                    }
+                }
+                const double centre[3] = { xMin + (col0 + 0.5 * cols) * dx, yMin + (row0 + 0.5 * rows) * dy, z };
+                if (useTree) {
+                    const double blockRadius = 0.5 * sqrt(cols * dx * cols * dx + rows * dy * rows * dy);
+                    scratch.sources.clear();
+                    collectPotentialSources(scratch.sources, 0, static_cast<int>(spatialNodes.size()),
+                                            centre, blockRadius, potentialTheta);
+                }
+                potentialTile(sources, scratch.local, px, py, centre, count, phi);
+                
+                for (size_t k = 0; k < count; k++) {
+                    double rx = px[k] - cx, ry = py[k] - cy;
+                    phi[k] -= halfOmegaSq * (rx * rx + ry * ry);
+                }
+                for (int r = 0; r < rows; r++) {
+                    float* line = out + static_cast<size_t>(row0 + r) * width + col0;
+                    for (int c = 0; c < cols; c++) {
+                        line[c] = static_cast<float>(phi[r * cols + c]);
+                    }
+                }
+            }
+        }
+    });
+}
+
+/**
+ * BULK I/O: flat body layouts shared by setBodies()/getBodies()
+ * Every record is a run of doubles; color travels as a double too.
+ */
+enum BodyLayout {
+    LAYOUT_RENDER,       // x, y, z, vx, vy, vz, mass, radius, color (= render state)
+    LAYOUT_FULL,         // x, y, z, vx, vy, vz, ax, ay, az, mass, radius, color
+    LAYOUT_PHASE_MASS,   // x, y, z, vx, vy, vz, mass (radius/color defaulted)
+    LAYOUT_COUNT
+};
+
+int bodyLayoutStride(int layout) {
+    switch (layout) {
+        case LAYOUT_RENDER: return 9;
+        case LAYOUT_FULL: return 12;
+        case LAYOUT_PHASE_MASS: return 7;
+    }
+    return 0;
+}
+
+int bodyLayoutMassOffset(int layout) {
+    return layout == LAYOUT_FULL ? 9 : 6;
+}
+
+Body unpackBody(const double* r, int layout) {
+    Body body = { r[0], r[1], r[2], r[3], r[4], r[5], 0.0, 0.0, 0.0,
+                  0.0, 2.0, 0xFFFFFFFF, 0.0, 0.0 };
+    switch (layout) {
+        case LAYOUT_RENDER:
+            body.mass = r[6];
+            body.radius = r[7];
+            body.color = static_cast<unsigned int>(r[8]);
+            break;
+        case LAYOUT_FULL:
+            body.ax = r[6];
+            body.ay = r[7];
+            body.az = r[8];
+            body.mass = r[9];
+            body.radius = r[10];
+            body.color = static_cast<unsigned int>(r[11]);
+            break;
+        case LAYOUT_PHASE_MASS:
+            body.mass = r[6];
+            break;
+    }
+    return body;
+}
+
+void packBody(const Body& body, double* r, int layout) {
+    r[0] = body.x;
+    r[1] = body.y;
+    r[2] = body.z;
+    r[3] = body.vx;
+    r[4] = body.vy;
+    r[5] = body.vz;
+    switch (layout) {
+        case LAYOUT_RENDER:
+            r[6] = body.mass;
+            r[7] = body.radius;
+            r[8] = static_cast<double>(body.color);
+            break;
+        case LAYOUT_FULL:
+            r[6] = body.ax;
+            r[7] = body.ay;
+            r[8] = body.az;
+            r[9] = body.mass;
+            r[10] = body.radius;
+            r[11] = static_cast<double>(body.color);
+            break;
+        case LAYOUT_PHASE_MASS:
+            r[6] = body.mass;
+            break;
+    }
+}
+
+/**
+ * ORBITAL ELEMENTS: batched osculating elements for overlays and analytics
+ * 
+ * Each body (or test particle) gets the two-body conic its current state
+ * describes about a reference: a chosen primary (μ = G (M + m)), the
+ * barycentre (μ = G M_total), or its hierarchical parent, i.e. the heavier
+ * body it is most tightly bound to (smallest bound a), which puts a moon on
+ * its planet and a planet on its star. Parents are searched among the
+ * ORBIT_PARENT_CANDIDATES heaviest bodies only, so a frame's worth of
+ * elements stays O(N) even for 10k bodies; bodies bound to none of them
+ * fall back to the barycentre.
+ * 
+ * With h = r × v, n = ẑ × h and e = ((v² - μ/r) r - (r·v) v) / μ:
+ *   a = -μ / (2 (v²/2 - μ/r)),  i = angle(h, ẑ),  Ω = angle(x̂, n)
+ *   ω = angle(n, e),  ν = angle(e, r)  (angles measured about h)
+ * Equatorial orbits measure from x̂ instead of n, circular ones from n
+ * instead of e (ω = 0), so every field stays finite.
+ */
+enum OrbitReference {
+    ORBIT_REFERENCE_BODY,        // Relative to one chosen primary
+    ORBIT_REFERENCE_BARYCENTER,  // Relative to the system barycentre
+    ORBIT_REFERENCE_PARENT       // Relative to each body's hierarchical parent
+};
+
+enum OrbitElementField {
+    ORBIT_PARENT,               // Reference body index, -1 = barycentre
+    ORBIT_SEMI_MAJOR_AXIS,      // a (negative when unbound)
+    ORBIT_ECCENTRICITY,
+    ORBIT_INCLINATION,          // Radians from the xy plane
+    ORBIT_ASCENDING_NODE,       // Ω, radians in [0, 2π)
+    ORBIT_ARG_PERIAPSIS,        // ω, radians in [0, 2π)
+    ORBIT_TRUE_ANOMALY,         // ν, radians in [0, 2π)
+    ORBIT_PERIOD,               // 0 when unbound
+    ORBIT_REL_X, ORBIT_REL_Y, ORBIT_REL_Z,      // Osculating state relative
+    ORBIT_REL_VX, ORBIT_REL_VY, ORBIT_REL_VZ,   // to the reference
+    ORBIT_RECORD_STRIDE
+};
+
+const size_t ORBIT_PARENT_CANDIDATES = 32;
+std::vector<size_t> orbitParentCandidates;   // Reused across calls
+
+// Angle from a to b about the unit normal h, in [0, 2π)
+inline double angleAbout(const double a[3], const double b[3], const double h[3]) {
+    double cx = a[1] * b[2] - a[2] * b[1];
+    double cy = a[2] * b[0] - a[0] * b[2];
+    double cz = a[0] * b[1] - a[1] * b[0];
+    double angle = atan2(cx * h[0] + cy * h[1] + cz * h[2], a[0] * b[0] + a[1] * b[1] + a[2] * b[2]);
+    return angle < 0.0 ? angle + 2.0 * M_PI : angle;
+}
+
+// Fill one record from a relative state about mu
+void writeOrbitRecord(const double r[3], const double v[3], double mu, double parent, double* out) {
+    out[ORBIT_PARENT] = parent;
+    for (int k = 0; k < 3; k++) {
+        out[ORBIT_REL_X + k] = r[k];
+        out[ORBIT_REL_VX + k] = v[k];
+    }
+    double rMag = sqrt(r[0] * r[0] + r[1] * r[1] + r[2] * r[2]);
+    if (rMag == 0.0 || mu <= 0.0) {
+        std::fill(out + ORBIT_SEMI_MAJOR_AXIS, out + ORBIT_REL_X, 0.0);
+        return;
+    }
+    double vSq = v[0] * v[0] + v[1] * v[1] + v[2] * v[2];
+    double rv = r[0] * v[0] + r[1] * v[1] + r[2] * v[2];
+    double h[3] = { r[1] * v[2] - r[2] * v[1], r[2] * v[0] - r[0] * v[2], r[0] * v[1] - r[1] * v[0] };
+    double hMag = sqrt(h[0] * h[0] + h[1] * h[1] + h[2] * h[2]);
+    double e[3];
+    for (int k = 0; k < 3; k++) {
+        e[k] = ((vSq - mu / rMag) * r[k] - rv * v[k]) / mu;
+    }
+    double eMag = sqrt(e[0] * e[0] + e[1] * e[1] + e[2] * e[2]);
+    double energy = 0.5 * vSq - mu / rMag;
+    double a = -mu / (2.0 * energy);
+    
+    // Radial orbits have no plane; treat them as equatorial
+    double hUnit[3] = { 0.0, 0.0, 1.0 };
+    if (hMag > 0.0) {
+        for (int k = 0; k < 3; k++) hUnit[k] = h[k] / hMag;
+    }
+    double nodeLen = sqrt(hUnit[0] * hUnit[0] + hUnit[1] * hUnit[1]);
+    const double xAxis[3] = { 1.0, 0.0, 0.0 };
+    const double zAxis[3] = { 0.0, 0.0, 1.0 };
+    double node[3] = { 1.0, 0.0, 0.0 };
+    if (nodeLen > 1e-12) {
+        node[0] = -hUnit[1] / nodeLen;
+        node[1] = hUnit[0] / nodeLen;
+    }
+    const bool circular = eMag < 1e-12;
+    
+    out[ORBIT_SEMI_MAJOR_AXIS] = a;
+    out[ORBIT_ECCENTRICITY] = eMag;
+    out[ORBIT_INCLINATION] = atan2(nodeLen, hUnit[2]);
+    out[ORBIT_ASCENDING_NODE] = nodeLen > 1e-12 ? angleAbout(xAxis, node, zAxis) : 0.0;
+    out[ORBIT_ARG_PERIAPSIS] = circular ? 0.0 : angleAbout(node, e, hUnit);
+    out[ORBIT_TRUE_ANOMALY] = angleAbout(circular ? node : e, r, hUnit);
+    out[ORBIT_PERIOD] = a > 0.0 ? 2.0 * M_PI * sqrt(a * a * a / mu) : 0.0;
+}
+
+// The heaviest bodies, heaviest first, as parent candidates
+void selectOrbitParentCandidates() {
+    orbitParentCandidates.resize(bodies.size());
+    for (size_t i = 0; i < bodies.size(); i++) orbitParentCandidates[i] = i;
+    size_t count = std::min(ORBIT_PARENT_CANDIDATES, bodies.size());
+    std::partial_sort(orbitParentCandidates.begin(), orbitParentCandidates.begin() + count,
+                      orbitParentCandidates.end(),
+                      [](size_t a, size_t b) { return bodies[a].mass > bodies[b].mass; });
+    orbitParentCandidates.resize(count);
+}
+
+// Heavier candidate the state (mass m, `self` = own index or -1) is most
+// tightly bound to, or -1
+int orbitParent(const double p[3], const double v[3], double m, int self) {
+    int best = -1;
+    double bestA = INFINITY;
+    for (size_t c : orbitParentCandidates) {
+        const Body& b = bodies[c];
+        if (static_cast<int>(c) == self || b.mass <= m) continue;
+        double dx = p[0] - b.x, dy = p[1] - b.y, dz = p[2] - b.z;
+        double dvx = v[0] - b.vx, dvy = v[1] - b.vy, dvz = v[2] - b.vz;
+        double mu = G * (b.mass + m);
+        double energy = 0.5 * (dvx * dvx + dvy * dvy + dvz * dvz) - mu / sqrt(dx * dx + dy * dy + dz * dz);
+        if (energy < 0.0) {
+            double a = -mu / (2.0 * energy);
+            if (a < bestA) {
+                bestA = a;
+                best = static_cast<int>(c);
+            }
+        }
+    }
+    return best;
+}
+
+/**
+ * Records for `count` states read through stateAt(i, pos, vel, mass, self)
+ * about the chosen reference; primary is only used by ORBIT_REFERENCE_BODY.
+ */
+template <typename StateAt>
+void writeOrbitalElements(size_t count, StateAt stateAt, int reference, int primary, double* out) {
+    double totalMass = 0.0;
+    double cm[3] = {}, cmVel[3] = {};
+    for (const auto& b : bodies) {
+        totalMass += b.mass;
+        cm[0] += b.mass * b.x;
+        cm[1] += b.mass * b.y;
+        cm[2] += b.mass * b.z;
+        cmVel[0] += b.mass * b.vx;
+        cmVel[1] += b.mass * b.vy;
+        cmVel[2] += b.mass * b.vz;
+    }
+    if (totalMass > 0.0) {
+        for (int k = 0; k < 3; k++) {
+            cm[k] /= totalMass;
+            cmVel[k] /= totalMass;
+        }
+    }
+    if (reference == ORBIT_REFERENCE_PARENT) {
+        selectOrbitParentCandidates();
+    }
+    
+    for (size_t i = 0; i < count; i++) {
+        double p[3], v[3], m;
+        int self;
+        stateAt(i, p, v, m, self);
+        double* record = out + i * ORBIT_RECORD_STRIDE;
+        
+        int parent = -1;
+        if (reference == ORBIT_REFERENCE_BODY) {
+            parent = primary;
+        } else if (reference == ORBIT_REFERENCE_PARENT) {
+            parent = orbitParent(p, v, m, self);
+        }
+        if (parent >= 0 && parent == self) {
+            // The primary itself has no orbit about itself
+            std::fill(record, record + ORBIT_RECORD_STRIDE, 0.0);
+            record[ORBIT_PARENT] = bodyRank(parent);
+            continue;
+        }
+        
+        double r[3], u[3];
+        double mu = G * totalMass;
+        if (parent >= 0) {
+            const Body& b = bodies[parent];
+            const double origin[6] = { b.x, b.y, b.z, b.vx, b.vy, b.vz };
+            for (int k = 0; k < 3; k++) {
+                r[k] = p[k] - origin[k];
+                u[k] = v[k] - origin[3 + k];
+            }
+            mu = G * (b.mass + m);
+        } else {
+            for (int k = 0; k < 3; k++) {
+                r[k] = p[k] - cm[k];
+                u[k] = v[k] - cmVel[k];
+            }
+        }
+        writeOrbitRecord(r, u, mu, bodyRank(parent), record);
+    }
+}
+
+/**
+ * GENERATORS: procedural large-N initial conditions
+ * All append to bodies (callers clear first when replacing the scene) and
+ * are seeded, so the same arguments always give the same scene.
+ */
+
+// Plummer sphere (Aarseth, Hénon & Wielen 1974) in virial equilibrium,
+// centred on the default viewport like the presets, with zero net momentum
+void generatePlummerSphere(size_t count, double totalMass, double scaleRadius, unsigned int seed) {
+    std::mt19937_64 rng(seed);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    
+    size_t first = bodies.size();
+    bodies.reserve(first + count);
+    double velocityScale = sqrt(G * totalMass / scaleRadius);
+    double vxSum = 0.0, vySum = 0.0, vzSum = 0.0;
+    for (size_t i = 0; i < count; i++) {
+        // Radius from the inverted cumulative mass profile
+        double u = std::max(uniform(rng), 1e-10);
+        double r = scaleRadius / sqrt(pow(u, -2.0 / 3.0) - 1.0);
+        r = std::min(r, 20.0 * scaleRadius);
+        
+        // Isotropic direction
+        double cosTheta = 2.0 * uniform(rng) - 1.0;
+        double sinTheta = sqrt(1.0 - cosTheta * cosTheta);
+        double phi = 2.0 * M_PI * uniform(rng);
+        
+        // Speed by rejection sampling of g(q) = q²(1 - q²)^3.5
+        double q = 0.0;
+        while (true) {
+            q = uniform(rng);
+            double g = q * q * pow(1.0 - q * q, 3.5);
+            if (0.1 * uniform(rng) < g) break;
+        }
+        double escape = sqrt(2.0) * pow(1.0 + r * r / (scaleRadius * scaleRadius), -0.25);
+        double speed = q * escape * velocityScale;
+        double vCosTheta = 2.0 * uniform(rng) - 1.0;
+        double vSinTheta = sqrt(1.0 - vCosTheta * vCosTheta);
+        double vPhi = 2.0 * M_PI * uniform(rng);
+        
+        double vx = speed * vSinTheta * cos(vPhi);
+        double vy = speed * vSinTheta * sin(vPhi);
+        double vz = speed * vCosTheta;
+        vxSum += vx;
+        vySum += vy;
+        vzSum += vz;
+        bodies.push_back({
+            400.0 + r * sinTheta * cos(phi), 300.0 + r * sinTheta * sin(phi), r * cosTheta,
+            vx, vy, vz,
+            0.0, 0.0, 0.0,
+            totalMass / count, 1.0,
+            0xFFF3B0FF,      // Pale star yellow
+            0.0, 0.0
+        });
+    }
+    
+    // Remove bulk drift so the cluster stays in view
+    for (size_t i = first; i < bodies.size(); i++) {
+        bodies[i].vx -= vxSum / count;
+        bodies[i].vy -= vySum / count;
+        bodies[i].vz -= vzSum / count;
+    }
+}
+
+// Ring of test-mass particles on near-circular orbits around a primary
+// (scale-height and eccentricity kept small so the ring stays thin)
+// One particle on a near-circular orbit around primary: r² uniform between
+// the edges (uniform surface density), 1% speed and 0.5% height jitter
+void sampleRingOrbit(const Body& primary, double innerRadius, double outerRadius,
+                     std::mt19937_64& rng, double position[3], double velocity[3]) {
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    std::normal_distribution<double> jitter(0.0, 1.0);
+    double r = sqrt(innerRadius * innerRadius +
+                    uniform(rng) * (outerRadius * outerRadius - innerRadius * innerRadius));
+    double angle = 2.0 * M_PI * uniform(rng);
+    double v = sqrt(G * primary.mass / r) * (1.0 + 0.01 * jitter(rng));
+    double z = 0.005 * r * jitter(rng);
+    
+    position[0] = primary.x + r * cos(angle);
+    position[1] = primary.y + r * sin(angle);
+    position[2] = primary.z + z;
+    velocity[0] = primary.vx - v * sin(angle);
+    velocity[1] = primary.vy + v * cos(angle);
+    velocity[2] = primary.vz;
+}
+
+void generateOrbitingRing(const Body& primary, size_t count, double innerRadius, double outerRadius,
+                          double particleMass, double radius, unsigned int color, std::mt19937_64& rng) {
+    bodies.reserve(bodies.size() + count);
+    for (size_t i = 0; i < count; i++) {
+        double pos[3], vel[3];
+        sampleRingOrbit(primary, innerRadius, outerRadius, rng, pos, vel);
+        bodies.push_back({
+            pos[0], pos[1], pos[2],
+            vel[0], vel[1], vel[2],
+            0.0, 0.0, 0.0,
+            particleMass, radius,
+            color,
+            0.0, 0.0
+        });
+    }
+}
+
+// Central star with a thin Keplerian disk of equal-mass particles
+void generateKeplerianDisk(size_t count, double centralMass, double innerRadius, double outerRadius, unsigned int seed) {
+    std::mt19937_64 rng(seed);
+    bodies.reserve(bodies.size() + count + 1);
+    bodies.push_back({
+        400.0, 300.0, 0.0,
+        0.0, 0.0, 0.0,
+        0.0, 0.0, 0.0,
+        centralMass, 20.0,
+        0xFDB813FF,      // Sun yellow
+        0.0, 0.0
+    });
+    Body star = bodies.back();
+    // Disk carries 1% of the star's mass in total
+    double particleMass = count > 0 ? 0.01 * centralMass / count : 0.0;
+    generateOrbitingRing(star, count, innerRadius, outerRadius, particleMass, 1.0, 0xA2D5F2FF, rng);
+}
+
+// Asteroid belt around the most massive body of the current scene
+void generateAsteroidBelt(size_t count, double innerRadius, double outerRadius, unsigned int seed) {
+    if (bodies.empty()) return;
+    std::mt19937_64 rng(seed);
+    size_t primary = 0;
+    for (size_t i = 1; i < bodies.size(); i++) {
+        if (bodies[i].mass > bodies[primary].mass) primary = i;
+    }
+    Body star = bodies[primary];
+    generateOrbitingRing(star, count, innerRadius, outerRadius, 1e-9 * star.mass, 1.0, 0x8C7853FF, rng);
+}
+
+// Same belt as massless test particles (see TEST PARTICLES)
+void generateTestParticleBelt(size_t count, double innerRadius, double outerRadius, unsigned int seed) {
+    if (bodies.empty()) return;
+    std::mt19937_64 rng(seed);
+    size_t primary = 0;
+    for (size_t i = 1; i < bodies.size(); i++) {
+        if (bodies[i].mass > bodies[primary].mass) primary = i;
+    }
+    const Body star = bodies[primary];
+    for (size_t i = 0; i < count; i++) {
+        double pos[3], vel[3];
+        sampleRingOrbit(star, innerRadius, outerRadius, rng, pos, vel);
+        testParticles.push(pos[0], pos[1], pos[2], vel[0], vel[1], vel[2]);
+    }
+    testParticleAccelValid = false;
 }
 
 /**
- * NASA GAME MODE: Threat Assessment and Mission Evaluation
- * Monitors asteroid trajectory and evaluates mission status
+ * SI SCENARIO MODE: physical units in, physical units out
+ * 
+ * Real masses (1e12 kg asteroids next to a 6e24 kg Earth) and distances
+ * (4e8 m) are far outside the engine's scaled units, so SI scenes are
+ * nondimensionalized on ingest:
+ *   length unit L  (default: largest distance from the heaviest body)
+ *   mass unit M    (default: heaviest body)
+ *   time unit T = sqrt(L³ / (G_SI M)), which makes G = 1 internally
+ * Softening and collision radii are then in units of L.
+ * 
+ * advanceSI() covers an arbitrary SI interval with adaptive substeps of
+ * eta × min over pairs of the free-fall time sqrt(r³ / G(m1+m2)) and the
+ * crossing time r / |v_rel|, so an 86,400 s game step stays accurate
+ * through close encounters. The criterion costs one O(N²) pass per substep.
  */
-void evaluateMissionStatus() {
-    if (gameMode != GAME_MODE_ACTIVE || missionState == MISSION_SUCCESS || missionState == MISSION_FAILURE) {
-        return;
+void setUnitSystem(double length, double mass) {
+    unitLength = length;
+    unitMass = mass;
+    unitTime = sqrt(length * length * length / (G_SI * mass));
+    unitVelocity = length / unitTime;
+}
+
+// Nondimensional substep from the closest pair timescale
+double adaptiveSubstep(double remaining) {
+    double shortest = remaining / substepAccuracy;
+    const size_t n = bodies.size();
+    for (size_t i = 0; i < n; i++) {
+        for (size_t j = i + 1; j < n; j++) {
+            double dx = bodies[j].x - bodies[i].x;
+            double dy = bodies[j].y - bodies[i].y;
+            double dz = bodies[j].z - bodies[i].z;
+            double r2 = dx * dx + dy * dy + dz * dz + softeningLength * softeningLength;
+            double r = sqrt(r2);
+            double mu = G * (bodies[i].mass + bodies[j].mass);
+            if (mu > 0.0) {
+                shortest = std::min(shortest, sqrt(r2 * r / mu));
+            }
+            double dvx = bodies[j].vx - bodies[i].vx;
+            double dvy = bodies[j].vy - bodies[i].vy;
+            double dvz = bodies[j].vz - bodies[i].vz;
+            double v2 = dvx * dvx + dvy * dvy + dvz * dvz;
+            if (v2 > 0.0) {
+                shortest = std::min(shortest, r / sqrt(v2));
+            }
+        }
     }
-    
-    // Update mission time
-    missionTime += dt * timeScale;
-    
-    // Check if bodies still exist
-    if (earthBodyIndex < 0 || earthBodyIndex >= bodies.size() || 
-        asteroidBodyIndex < 0 || asteroidBodyIndex >= bodies.size()) {
-        return;
+    return std::min(remaining, substepAccuracy * shortest);
+}
+
+// Scaled presets and loads run in the engine's native units again
+void leaveSIMode() {
+    if (siMode) {
+        siMode = false;
+        G = scaledG;
+        unitLength = unitMass = unitTime = unitVelocity = 1.0;
     }
-    
-    // Calculate distance between Earth and asteroid
-    double dx = bodies[asteroidBodyIndex].x - bodies[earthBodyIndex].x;
-    double dy = bodies[asteroidBodyIndex].y - bodies[earthBodyIndex].y;
-    double dz = bodies[asteroidBodyIndex].z - bodies[earthBodyIndex].z;
-    double distance = sqrt(dx * dx + dy * dy + dz * dz);
-    
-    // Track closest approach
-    if (distance < closestApproach) {
-        closestApproach = distance;
+}
+
+// Fill renderState (see RenderHeaderField); interpolated blends in the
+// last advanceFrame() step when the state has not been edited since
+double* buildRenderState(bool withDiagnostics, bool interpolated) {
+    const size_t particleCount = testParticles.size();
+    size_t size = RENDER_HEADER_SIZE + bodies.size() * RENDER_BODY_STRIDE +
+                  particleCount * RENDER_PARTICLE_STRIDE;
+    if (renderState.size() != size) {
+        renderState.resize(size);
     }
-    
-    // Check for collision
-    if (distance < threatRadius) {
-        missionState = MISSION_FAILURE;
-        printf("MISSION FAILED: Asteroid impact! Distance: %.2f km\n", distance);
-        return;
+    double* header = renderState.data();
+    header[RENDER_BODY_COUNT] = static_cast<double>(bodies.size());
+    header[RENDER_TEST_PARTICLE_COUNT] = static_cast<double>(particleCount);
+    header[RENDER_SIMULATION_TIME] = simulationTime;
+    header[RENDER_TIME_STEP] = dt;
+    header[RENDER_GAME_MODE] = static_cast<double>(gameMode);
+    header[RENDER_MISSION_STATE] = static_cast<double>(missionState);
+    
+    if (withDiagnostics && !bodies.empty()) {
+        ensureDiagnostics();
+        header[RENDER_TOTAL_ENERGY] = totalEnergy;
+        header[RENDER_MOMENTUM_X] = totalMomentumX;
+        header[RENDER_MOMENTUM_Y] = totalMomentumY;
+        header[RENDER_MOMENTUM_Z] = totalMomentumZ;
+        header[RENDER_ANGULAR_MOMENTUM] = sqrt(angularMomentumX * angularMomentumX +
+                                               angularMomentumY * angularMomentumY +
+                                               angularMomentumZ * angularMomentumZ);
+        header[RENDER_ENERGY_DRIFT] = energyDrift;
+        header[RENDER_MOMENTUM_DRIFT] = momentumDrift;
+        header[RENDER_ANGULAR_MOMENTUM_DRIFT] = angularMomentumDrift;
+        header[RENDER_CENTER_OF_MASS_X] = centerOfMassX;
+        header[RENDER_CENTER_OF_MASS_Y] = centerOfMassY;
+        header[RENDER_CENTER_OF_MASS_Z] = centerOfMassZ;
     }
     
-    // Check for close approach warning
-    if (distance < threatRadius * 3.0 && missionState == MISSION_RUNNING) {
-        missionState = MISSION_WARNING;
+    double* out = header + RENDER_HEADER_SIZE;
+    for (size_t i = 0; i < bodies.size(); i++) {
+        const Body& body = bodyAt(i);
+        out[0] = body.x;
+        out[1] = body.y;
+        out[2] = body.z;
+        out[3] = body.vx;
+        out[4] = body.vy;
+        out[5] = body.vz;
+        out[6] = body.mass;
+        out[7] = body.radius;
+        out[8] = static_cast<double>(body.color);
+        out += RENDER_BODY_STRIDE;
     }
     
-    // Check time limit
-    if (missionTime > timeLimit) {
-        if (closestApproach > threatRadius * safetyMargin) {
-            missionState = MISSION_SUCCESS;
-            missionScore = (int)(1000.0 * (closestApproach / (threatRadius * safetyMargin)) * 
-                                 (1.0 - deltaVUsed / deltaVBudget) * 
-                                 (1.0 - missionTime / timeLimit));
-            printf("MISSION SUCCESS! Closest approach: %.2f km, Score: %d\n", closestApproach, missionScore);
-        } else {
-            missionState = MISSION_FAILURE;
-            printf("MISSION FAILED: Asteroid too close (%.2f km)\n", closestApproach);
+    bool blend = interpolated && interpolationVersion == stateVersion &&
+                 previousBodies.size() == bodies.size();
+    if (blend) {
+        double alpha = frameAccumulator;
+        double* record = header + RENDER_HEADER_SIZE;
+        for (size_t i = 0; i < bodies.size(); i++) {
+            size_t slot = bodySlot(i);
+            hermiteInterpolate(previousBodies[slot], bodies[slot], lastFrameStep, alpha, record, record + 3);
+            record += RENDER_BODY_STRIDE;
         }
+        header[RENDER_SIMULATION_TIME] = simulationTime - (1.0 - alpha) * lastFrameStep;
     }
-}
-
-void updateBodies() {
-    switch (currentMethod) {
-        case METHOD_EULER:
-            updateBodiesEuler();
-            break;
-        case METHOD_VERLET:
-            updateBodiesVerlet();
-            break;
-        case METHOD_RK4:
-            updateBodiesRK4();
-            break;
-        case METHOD_RKF45:
-            updateBodiesRKF45();
-            break;
+    
+    // Test particles: backed off linearly to the same instant when blending
+    const double back = blend ? (1.0 - frameAccumulator) * lastFrameStep : 0.0;
+    for (size_t k = 0; k < particleCount; k++) {
+        out[0] = testParticles.x[k] - back * testParticles.vx[k];
+        out[1] = testParticles.y[k] - back * testParticles.vy[k];
+        out[2] = testParticles.z[k] - back * testParticles.vz[k];
+        out += RENDER_PARTICLE_STRIDE;
     }
-    calculateSystemProperties();
-    evaluateMissionStatus();
+    return header;
 }
 
 
@@ -1230,7 +5628,7 @@ extern "C" {
     EMSCRIPTEN_KEEPALIVE
     double getBodyX(int index) {
         if (index >= 0 && index < bodies.size()) {
-            return bodies[index].x;
+            return bodyAt(index).x;
         }
         return 0.0;
     }
@@ -1238,7 +5636,7 @@ extern "C" {
     EMSCRIPTEN_KEEPALIVE
     double getBodyY(int index) {
         if (index >= 0 && index < bodies.size()) {
-            return bodies[index].y;
+            return bodyAt(index).y;
         }
         return 0.0;
     }
@@ -1246,7 +5644,7 @@ extern "C" {
     EMSCRIPTEN_KEEPALIVE
     double getBodyZ(int index) {
         if (index >= 0 && index < bodies.size()) {
-            return bodies[index].z;
+            return bodyAt(index).z;
         }
         return 0.0;
     }
@@ -1254,7 +5652,7 @@ extern "C" {
     EMSCRIPTEN_KEEPALIVE
     double getBodyRadius(int index) {
         if (index >= 0 && index < bodies.size()) {
-            return bodies[index].radius;
+            return bodyAt(index).radius;
         }
         return 0.0;
     }
@@ -1262,7 +5660,7 @@ extern "C" {
     EMSCRIPTEN_KEEPALIVE
     unsigned int getBodyColor(int index) {
         if (index >= 0 && index < bodies.size()) {
-            return bodies[index].color;
+            return bodyAt(index).color;
         }
         return 0xFFFFFFFF;
     }
@@ -1270,7 +5668,7 @@ extern "C" {
     EMSCRIPTEN_KEEPALIVE
     double getBodyVX(int index) {
         if (index >= 0 && index < bodies.size()) {
-            return bodies[index].vx;
+            return bodyAt(index).vx;
         }
         return 0.0;
     }
@@ -1278,7 +5676,7 @@ extern "C" {
     EMSCRIPTEN_KEEPALIVE
     double getBodyVY(int index) {
         if (index >= 0 && index < bodies.size()) {
-            return bodies[index].vy;
+            return bodyAt(index).vy;
         }
         return 0.0;
     }
@@ -1286,7 +5684,7 @@ extern "C" {
     EMSCRIPTEN_KEEPALIVE
     double getBodyVZ(int index) {
         if (index >= 0 && index < bodies.size()) {
-            return bodies[index].vz;
+            return bodyAt(index).vz;
         }
         return 0.0;
     }
@@ -1294,7 +5692,7 @@ extern "C" {
     EMSCRIPTEN_KEEPALIVE
     double getBodyMass(int index) {
         if (index >= 0 && index < bodies.size()) {
-            return bodies[index].mass;
+            return bodyAt(index).mass;
         }
         return 0.0;
     }
@@ -1306,42 +5704,50 @@ extern "C" {
     
     EMSCRIPTEN_KEEPALIVE
     double getTotalEnergy() {
+        ensureDiagnostics();
         return totalEnergy;
     }
     
     EMSCRIPTEN_KEEPALIVE
     double getMomentumX() {
+        ensureDiagnostics();
         return totalMomentumX;
     }
     
     EMSCRIPTEN_KEEPALIVE
     double getMomentumY() {
+        ensureDiagnostics();
         return totalMomentumY;
     }
     
     EMSCRIPTEN_KEEPALIVE
     double getMomentumZ() {
+        ensureDiagnostics();
         return totalMomentumZ;
     }
     
     EMSCRIPTEN_KEEPALIVE
     double getCenterOfMassX() {
+        ensureDiagnostics();
         return centerOfMassX;
     }
     
     EMSCRIPTEN_KEEPALIVE
     double getCenterOfMassY() {
+        ensureDiagnostics();
         return centerOfMassY;
     }
     
     EMSCRIPTEN_KEEPALIVE
     double getCenterOfMassZ() {
+        ensureDiagnostics();
         return centerOfMassZ;
     }
     
     EMSCRIPTEN_KEEPALIVE
     void setGravitationalConstant(double g) {
         G = g;
+        markDiagnosticsDirty();
     }
     
     EMSCRIPTEN_KEEPALIVE
@@ -1371,8 +5777,8 @@ extern "C" {
     
     EMSCRIPTEN_KEEPALIVE
     void setIntegrator(int method) {
-        // 0=Euler, 1=Verlet, 2=RK4, 3=RKF45
-        if (method >= 0 && method <= 3) {
+        // 0=Euler, 1=Verlet, 2=RK4, 3=RKF45, 4=Hermite
+        if (method >= METHOD_EULER && method <= METHOD_HERMITE) {
             currentMethod = static_cast<IntegrationMethod>(method);
         }
     }
@@ -1392,6 +5798,17 @@ extern "C" {
         return enableCollisions ? 1 : 0;
     }
     
+    // Swept-sphere collision detection (time of impact inside the step)
+    EMSCRIPTEN_KEEPALIVE
+    void setContinuousCollisions(int enabled) {
+        continuousCollisions = (enabled != 0);
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    int getContinuousCollisions() {
+        return continuousCollisions ? 1 : 0;
+    }
+    
     EMSCRIPTEN_KEEPALIVE
     void setCollisionDamping(double damping) {
         collisionDamping = damping;
@@ -1401,6 +5818,8 @@ extern "C" {
     void loadPreset(int presetType) {
         // Disable game mode for academic presets
         gameMode = GAME_MODE_DISABLED;
+        leaveSIMode();
+        discardTestParticles();
         
         switch (presetType) {
             case PRESET_FIGURE_EIGHT:
@@ -1428,106 +5847,626 @@ extern "C" {
                 loadNASAAsteroidDefense(1);  // Default medium difficulty
                 return;  // Skip normal initialization for game mode
         }
-        initialBodies = bodies;
+        saveInitialBodies();
+        markDiagnosticsDirty();
         calculateSystemProperties();
         saveInitialState();  // Save conservation baselines
     }
     
+    /**
+     * Bulk ingest: replace the scene with count records read from WASM memory
+     * (layout: see BodyLayout). Returns the number of bodies loaded.
+     */
+    EMSCRIPTEN_KEEPALIVE
+    int setBodies(const double* data, int count, int layout) {
+        int stride = bodyLayoutStride(layout);
+        if (!data || count < 0 || stride == 0) return 0;
+        gameMode = GAME_MODE_DISABLED;
+        leaveSIMode();
+        clearBodyStore();
+        bodies.reserve(count);
+        discardTestParticles();
+        for (int i = 0; i < count; i++) {
+            bodies.push_back(unpackBody(data + static_cast<size_t>(i) * stride, layout));
+        }
+        saveInitialBodies();
+        requestBaseline();
+        return count;
+    }
+    
+    // Bulk export: writes getBodyCount() records; out must hold count * stride doubles
+    EMSCRIPTEN_KEEPALIVE
+    int getBodies(double* out, int layout) {
+        int stride = bodyLayoutStride(layout);
+        if (!out || stride == 0) return 0;
+        for (size_t i = 0; i < bodies.size(); i++) {
+            packBody(bodyAt(i), out + i * stride, layout);
+        }
+        return static_cast<int>(bodies.size());
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    int getBodyLayoutStride(int layout) {
+        return bodyLayoutStride(layout);
+    }
+    
+    /**
+     * Osculating elements of every body (see ORBITAL ELEMENTS) as
+     * ORBIT_RECORD_STRIDE doubles per body; out must hold count * stride
+     * doubles. reference: OrbitReference; primary: body index for
+     * ORBIT_REFERENCE_BODY. Returns the number of records written.
+     */
+    EMSCRIPTEN_KEEPALIVE
+    int getOrbitalElements(double* out, int reference, int primary) {
+        if (!out || reference < ORBIT_REFERENCE_BODY || reference > ORBIT_REFERENCE_PARENT) return 0;
+        if (reference == ORBIT_REFERENCE_BODY && (primary < 0 || primary >= static_cast<int>(bodies.size()))) {
+            return 0;
+        }
+        writeOrbitalElements(bodies.size(), [](size_t i, double p[3], double v[3], double& m, int& self) {
+            const Body& b = bodyAt(i);
+            p[0] = b.x;
+            p[1] = b.y;
+            p[2] = b.z;
+            v[0] = b.vx;
+            v[1] = b.vy;
+            v[2] = b.vz;
+            m = b.mass;
+            self = static_cast<int>(bodySlot(i));
+        }, reference, bodyReferenceSlot(primary), out);
+        return static_cast<int>(bodies.size());
+    }
+    
+    // Same for the test particles (massless, never a parent themselves)
+    EMSCRIPTEN_KEEPALIVE
+    int getTestParticleElements(double* out, int reference, int primary) {
+        if (!out || reference < ORBIT_REFERENCE_BODY || reference > ORBIT_REFERENCE_PARENT) return 0;
+        if (reference == ORBIT_REFERENCE_BODY && (primary < 0 || primary >= static_cast<int>(bodies.size()))) {
+            return 0;
+        }
+        const TestParticles& t = testParticles;
+        writeOrbitalElements(t.size(), [&t](size_t i, double p[3], double v[3], double& m, int& self) {
+            p[0] = t.x[i];
+            p[1] = t.y[i];
+            p[2] = t.z[i];
+            v[0] = t.vx[i];
+            v[1] = t.vy[i];
+            v[2] = t.vz[i];
+            m = 0.0;
+            self = -1;
+        }, reference, bodyReferenceSlot(primary), out);
+        return static_cast<int>(t.size());
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    int getOrbitRecordStride() {
+        return ORBIT_RECORD_STRIDE;
+    }
+    
+    // Procedural scenes (see GENERATORS); baselines are captured lazily
+    EMSCRIPTEN_KEEPALIVE
+    void loadPlummerSphere(int count, double totalMass, double scaleRadius, int seed) {
+        gameMode = GAME_MODE_DISABLED;
+        leaveSIMode();
+        discardTestParticles();
+        clearBodyStore();
+        generatePlummerSphere(std::max(count, 0), totalMass, scaleRadius, seed);
+        saveInitialBodies();
+        requestBaseline();
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    void loadKeplerianDisk(int count, double centralMass, double innerRadius, double outerRadius, int seed) {
+        gameMode = GAME_MODE_DISABLED;
+        leaveSIMode();
+        discardTestParticles();
+        clearBodyStore();
+        generateKeplerianDisk(std::max(count, 0), centralMass, innerRadius, outerRadius, seed);
+        saveInitialBodies();
+        requestBaseline();
+    }
+    
+    // Adds a belt to the current scene (e.g. after loadPreset(PRESET_SOLAR_SYSTEM))
+    EMSCRIPTEN_KEEPALIVE
+    void addAsteroidBelt(int count, double innerRadius, double outerRadius, int seed) {
+        generateAsteroidBelt(std::max(count, 0), innerRadius, outerRadius, seed);
+        saveInitialBodies();
+        requestBaseline();
+    }
+    
+    /**
+     * Test particles (massless, see TEST PARTICLES). Positions and velocities
+     * are in the engine's current units. Each call that adds particles also
+     * appends them to the state reset() returns to (like addBody, the rest
+     * of that state is left as saved).
+     */
+    EMSCRIPTEN_KEEPALIVE
+    int addTestParticle(double x, double y, double z, double vx, double vy, double vz) {
+        testParticles.push(x, y, z, vx, vy, vz);
+        testParticleAccelValid = false;
+        initialTestParticles.push(x, y, z, vx, vy, vz);
+        return static_cast<int>(testParticles.size()) - 1;
+    }
+    
+    // Replace all test particles from records of x, y, z, vx, vy, vz
+    EMSCRIPTEN_KEEPALIVE
+    int setTestParticles(const double* data, int count) {
+        if (!data || count < 0) return 0;
+        testParticles.clear();
+        for (int i = 0; i < count; i++) {
+            const double* r = data + static_cast<size_t>(i) * 6;
+            testParticles.push(r[0], r[1], r[2], r[3], r[4], r[5]);
+        }
+        testParticleAccelValid = false;
+        initialTestParticles = testParticles;
+        return count;
+    }
+    
+    // Belt of test particles around the heaviest body, like addAsteroidBelt
+    EMSCRIPTEN_KEEPALIVE
+    void addTestParticleBelt(int count, double innerRadius, double outerRadius, int seed) {
+        const size_t first = testParticles.size();
+        generateTestParticleBelt(std::max(count, 0), innerRadius, outerRadius, seed);
+        for (size_t i = first; i < testParticles.size(); i++) {
+            initialTestParticles.push(testParticles.x[i], testParticles.y[i], testParticles.z[i],
+                                      testParticles.vx[i], testParticles.vy[i], testParticles.vz[i]);
+        }
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    void clearTestParticles() {
+        discardTestParticles();
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    int getTestParticleCount() {
+        return static_cast<int>(testParticles.size());
+    }
+    
+    // Zero-copy view of one SoA field (0-5: x, y, z, vx, vy, vz); valid
+    // until particles are added or removed
+    EMSCRIPTEN_KEEPALIVE
+    double* getTestParticleArray(int field) {
+        std::vector<double>* fields[] = {&testParticles.x, &testParticles.y, &testParticles.z,
+                                         &testParticles.vx, &testParticles.vy, &testParticles.vz};
+        if (field < 0 || field >= 6) return nullptr;
+        return fields[field]->data();
+    }
+    
+    /**
+     * SI scenario ingest: like setBodies, but positions in m, velocities in
+     * m/s, masses in kg and radii in m. lengthUnit/massUnit <= 0 pick the
+     * defaults described under SI SCENARIO MODE.
+     */
+    EMSCRIPTEN_KEEPALIVE
+    int setBodiesSI(const double* data, int count, int layout, double lengthUnit, double massUnit) {
+        const size_t stride = static_cast<size_t>(bodyLayoutStride(layout));
+        if (!data || count <= 0 || stride == 0) return 0;
+        
+        const size_t massOffset = static_cast<size_t>(bodyLayoutMassOffset(layout));
+        size_t heaviest = 0;
+        for (int i = 1; i < count; i++) {
+            if (data[static_cast<size_t>(i) * stride + massOffset] > data[heaviest * stride + massOffset]) {
+                heaviest = static_cast<size_t>(i);
+            }
+        }
+        if (massUnit <= 0.0) {
+            massUnit = data[heaviest * stride + massOffset];
+        }
+        if (lengthUnit <= 0.0) {
+            const double* h = data + heaviest * stride;
+            for (int i = 0; i < count; i++) {
+                const double* r = data + static_cast<size_t>(i) * stride;
+                double dx = r[0] - h[0], dy = r[1] - h[1], dz = r[2] - h[2];
+                lengthUnit = std::max(lengthUnit, sqrt(dx * dx + dy * dy + dz * dz));
+            }
+        }
+        if (massUnit <= 0.0 || lengthUnit <= 0.0) return 0;
+        
+        setBodies(data, count, layout);
+        setUnitSystem(lengthUnit, massUnit);
+        scaledG = G;
+        siMode = true;
+        G = 1.0;
+        for (auto& body : bodies) {
+            body.x /= unitLength;
+            body.y /= unitLength;
+            body.z /= unitLength;
+            body.vx /= unitVelocity;
+            body.vy /= unitVelocity;
+            body.vz /= unitVelocity;
+            body.ax /= unitLength / (unitTime * unitTime);
+            body.ay /= unitLength / (unitTime * unitTime);
+            body.az /= unitLength / (unitTime * unitTime);
+            body.mass /= unitMass;
+            body.radius /= unitLength;
+        }
+        saveInitialBodies();
+        return count;
+    }
+    
+    // SI export in the same layouts (m, m/s, m/s², kg)
+    EMSCRIPTEN_KEEPALIVE
+    int getBodiesSI(double* out, int layout) {
+        int stride = bodyLayoutStride(layout);
+        if (!out || stride == 0) return 0;
+        for (size_t i = 0; i < bodies.size(); i++) {
+            Body body = bodyAt(i);
+            body.x *= unitLength;
+            body.y *= unitLength;
+            body.z *= unitLength;
+            body.vx *= unitVelocity;
+            body.vy *= unitVelocity;
+            body.vz *= unitVelocity;
+            body.ax *= unitLength / (unitTime * unitTime);
+            body.ay *= unitLength / (unitTime * unitTime);
+            body.az *= unitLength / (unitTime * unitTime);
+            body.mass *= unitMass;
+            body.radius *= unitLength;
+            packBody(body, out + i * stride, layout);
+        }
+        return static_cast<int>(bodies.size());
+    }
+    
+    /**
+     * Advance an SI scene by seconds of physical time with adaptive
+     * substeps (at most maxSubsteps; 0 = unlimited). Returns the number of
+     * substeps taken. Uses the selected integrator.
+     */
+    EMSCRIPTEN_KEEPALIVE
+    int advanceSI(double seconds, int maxSubsteps) {
+        if (!siMode || seconds <= 0.0) return 0;
+        double savedDt = dt;
+        double savedTimeScale = timeScale;
+        timeScale = 1.0;
+        
+        double remaining = seconds / unitTime;
+        int substeps = 0;
+        while (remaining > 0.0 && (maxSubsteps <= 0 || substeps < maxSubsteps)) {
+            // The last substep of a budget-capped call takes what is left
+            dt = (maxSubsteps > 0 && substeps == maxSubsteps - 1) ? remaining :
+                 std::max(adaptiveSubstep(remaining), std::min(remaining, keplerJumpLimit()));
+            updateBodies();
+            remaining -= dt;
+            substeps++;
+        }
+        
+        dt = savedDt;
+        timeScale = savedTimeScale;
+        return substeps;
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    void setSubstepAccuracy(double eta) {
+        if (eta > 0.0) substepAccuracy = eta;
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    double getSubstepAccuracy() {
+        return substepAccuracy;
+    }
+    
+    // Internal units of the current SI scene (1 when not in SI mode)
+    EMSCRIPTEN_KEEPALIVE
+    double getUnitLength() {
+        return unitLength;
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    double getUnitMass() {
+        return unitMass;
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    double getUnitTime() {
+        return unitTime;
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    double getSimulationTimeSI() {
+        return simulationTime * unitTime;
+    }
+    
+    // Returns the new body's handle (see getBodyIndex)
+    EMSCRIPTEN_KEEPALIVE
+    double addBody(double x, double y, double vx, double vy, double mass, double radius, unsigned int color) {
+        bodies.push_back({
+            x, y, 0.0, vx, vy, 0.0, 0.0, 0.0, 0.0,
+            mass, radius, color,
+            0.0, 0.0
+        });
+        appendInitialBody(bodies.size() - 1);
+        markDiagnosticsDirty();
+        return static_cast<double>(bodyHandle(bodies.size() - 1));
+    }
+    
+    // O(1); the body with the last index takes over the removed index, and
+    // the body leaves the reset() snapshot the same way
+    EMSCRIPTEN_KEEPALIVE
+    void removeBody(int index) {
+        if (index >= 0 && static_cast<size_t>(index) < bodies.size()) {
+            const size_t slot = bodySlot(index);
+            eraseInitialBody(bodyHandle(slot));
+            eraseBody(slot);
+            markDiagnosticsDirty();
+        }
+    }
+    
+    /**
+     * Stable handles: a body's handle never changes, while its index can
+     * after removals and merges. getBodyIndex() translates a handle to the
+     * body's current index, or -1 once the body is gone (merged, removed,
+     * or the scene was replaced or reset).
+     */
+    EMSCRIPTEN_KEEPALIVE
+    double getBodyHandle(int index) {
+        if (index < 0 || static_cast<size_t>(index) >= bodies.size()) return 0.0;
+        return static_cast<double>(bodyHandle(bodySlot(index)));
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    int getBodyIndex(double handle) {
+        if (!(handle > 0.0 && handle < 9007199254740992.0)) return -1;   // 2^53
+        return bodyRank(bodyHandleSlot(static_cast<BodyHandle>(handle)));
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    void clearBodies() {
+        clearBodyStore();
+        initialBodies.clear();
+        initialBodyHandles.clear();
+        discardTestParticles();
+        markDiagnosticsDirty();
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    void init() {
+        initBodies();
+        saveInitialBodies();
+        calculateSystemProperties();
+        saveInitialState();  // Initialize conservation baselines
+        printf("Three-body simulation initialized with %zu bodies\n", bodies.size());
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    void reset() {
+        restoreInitialBodies();
+        testParticles = initialTestParticles;
+        testParticleAccelValid = false;
+        markDiagnosticsDirty();
+        calculateSystemProperties();
+        saveInitialState();  // Reset conservation baselines
+    }
+    
+    // New interactive functions
+    EMSCRIPTEN_KEEPALIVE
+    void setBodyPosition(int index, double x, double y) {
+        if (index >= 0 && index < bodies.size()) {
+            Body& body = bodies[bodySlot(index)];
+            body.x = x;
+            body.y = y;
+            // z remains unchanged (0 for 2D view)
+            markDiagnosticsDirty();
+        }
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    void setBodyVelocity(int index, double vx, double vy) {
+        if (index >= 0 && index < bodies.size()) {
+            Body& body = bodies[bodySlot(index)];
+            body.vx = vx;
+            body.vy = vy;
+            // vz remains unchanged (0 for 2D view)
+            markDiagnosticsDirty();
+        }
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    void setBodyMass(int index, double mass) {
+        if (index >= 0 && index < bodies.size()) {
+            Body& body = bodies[bodySlot(index)];
+            body.mass = mass;
+            // Update radius based on mass (radius ~ mass^(1/3) for constant density)
+            body.radius = 5.0 + pow(mass / 10.0, 0.4) * 5.0;
+            markDiagnosticsDirty();
+        }
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    void setBodyColor(int index, unsigned int color) {
+        if (index >= 0 && index < bodies.size()) {
+            bodies[bodySlot(index)].color = color;
+        }
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    int findBodyAtPosition(double x, double y) {
+        // Use 2D projection (ignore z for clicking); the topmost (highest
+        // index) body wins when pick discs overlap
+        ensureSpatialIndex();
+        int best = -1;
+        pickSpatialRange(0, static_cast<int>(spatialNodes.size()), x, y, best);
+        return best;
+    }
+    
+    /**
+     * k nearest bodies to (x, y, z), closest first. out must hold k ints;
+     * returns the number written (less than k only if there are fewer bodies).
+     */
+    EMSCRIPTEN_KEEPALIVE
+    int findNearestBodies(double x, double y, double z, int k, int* out) {
+        if (!out || k <= 0) return 0;
+        ensureSpatialIndex();
+        const double q[3] = { x, y, z };
+        spatialHeap.clear();
+        spatialHeap.reserve(k);
+        nearestSpatialRange(0, static_cast<int>(spatialNodes.size()), q, static_cast<size_t>(k));
+        std::sort_heap(spatialHeap.begin(), spatialHeap.end());
+        for (size_t i = 0; i < spatialHeap.size(); i++) {
+            out[i] = bodyRank(spatialHeap[i].second);
+        }
+        return static_cast<int>(spatialHeap.size());
+    }
+    
+    /**
+     * Bodies within radius of (x, y, z), in no particular order. Writes at
+     * most maxResults indices to out and returns the total number found, so
+     * a caller can retry with a larger buffer.
+     */
+    EMSCRIPTEN_KEEPALIVE
+    int findBodiesInRadius(double x, double y, double z, double radius, int* out, int maxResults) {
+        if (radius < 0.0) return 0;
+        if (!out) maxResults = 0;
+        ensureSpatialIndex();
+        const double q[3] = { x, y, z };
+        int found = 0;
+        radiusSpatialRange(0, static_cast<int>(spatialNodes.size()), q, radius, out, maxResults, found);
+        return found;
+    }
+    
+    /**
+     * Body order (see BODY ORDER): 0 = insertion order, 1 = Morton,
+     * 2 = Hilbert (default). External indices are unaffected; only the
+     * internal layout changes.
+     */
+    EMSCRIPTEN_KEEPALIVE
+    void setBodyOrdering(int ordering) {
+        if (ordering < BODY_ORDER_NONE || ordering > BODY_ORDER_HILBERT) return;
+        bodyOrdering = ordering;
+        stepsSinceOrderCheck = 0;
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    int getBodyOrdering() {
+        return bodyOrdering;
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    void setBodyOrderThreshold(double disorder) {
+        bodyOrderThreshold = std::max(disorder, 0.0);
+    }
+    
+    // Fraction of neighbouring slots out of curve order, measured now
+    EMSCRIPTEN_KEEPALIVE
+    double getBodyOrderDisorder() {
+        bodyOrderDisorder = measureBodyDisorder();
+        return bodyOrderDisorder;
+    }
+    
+    // Sort now regardless of size and disorder (e.g. right after a bulk load)
+    EMSCRIPTEN_KEEPALIVE
+    void reorderBodies() {
+        sortBodies();
+    }
+    
     EMSCRIPTEN_KEEPALIVE
-    void addBody(double x, double y, double vx, double vy, double mass, double radius, unsigned int color) {
-        bodies.push_back({
-            x, y, 0.0, vx, vy, 0.0, 0.0, 0.0, 0.0,
-            mass, radius, color,
-            0.0, 0.0
-        });
-        initialBodies = bodies;
+    double getBodyReorderCount() {
+        return static_cast<double>(bodyReorders);
     }
     
+    /**
+     * Potential map (see POTENTIAL MAPS): width × height floats, row-major
+     * from (xMin, yMin), sampled at cell centres in the plane z. omega != 0
+     * gives the effective potential in a frame rotating at omega about the
+     * barycentre (getSystemRotationRate() for the Lagrange preset). Returns
+     * the number of values written.
+     */
     EMSCRIPTEN_KEEPALIVE
-    void removeBody(int index) {
-        if (index >= 0 && index < bodies.size()) {
-            bodies.erase(bodies.begin() + index);
-            initialBodies = bodies;
-        }
+    int evaluatePotentialMap(float* out, int width, int height, double xMin, double yMin,
+                             double xMax, double yMax, double z, double omega) {
+        if (!out || width <= 0 || height <= 0) return 0;
+        potentialMap(out, width, height, xMin, yMin, xMax, yMax, z, omega);
+        return width * height;
     }
     
     EMSCRIPTEN_KEEPALIVE
-    void clearBodies() {
-        bodies.clear();
-        initialBodies.clear();
+    double getSystemRotationRate() {
+        return systemRotationRate();
     }
     
+    // Opening angle of the monopole tree used for large scenes
     EMSCRIPTEN_KEEPALIVE
-    void init() {
-        initBodies();
-        initialBodies = bodies;
-        calculateSystemProperties();
-        saveInitialState();  // Initialize conservation baselines
-        printf("Three-body simulation initialized with %zu bodies\n", bodies.size());
+    void setPotentialTheta(double theta) {
+        if (theta >= 0.0) potentialTheta = theta;
     }
     
     EMSCRIPTEN_KEEPALIVE
-    void reset() {
-        bodies = initialBodies;
-        calculateSystemProperties();
-        saveInitialState();  // Reset conservation baselines
+    double getPotentialTheta() {
+        return potentialTheta;
     }
     
-    // New interactive functions
+    /**
+     * Periodic orbits (see PERIODIC ORBITS). findPeriodicOrbit refines the
+     * current bodies into an exactly periodic state near periodGuess and
+     * makes it the reset state; returns the Newton iteration count, or -1
+     * (bodies untouched) if it did not converge.
+     */
     EMSCRIPTEN_KEEPALIVE
-    void setBodyPosition(int index, double x, double y) {
-        if (index >= 0 && index < bodies.size()) {
-            bodies[index].x = x;
-            bodies[index].y = y;
-            // z remains unchanged (0 for 2D view)
+    int findPeriodicOrbit(double periodGuess, int maxIterations) {
+        int iterations = refinePeriodicOrbit(periodGuess, std::max(maxIterations, 0));
+        if (iterations >= 0) {
+            saveInitialBodies();
+            requestBaseline();
         }
+        return iterations;
     }
     
     EMSCRIPTEN_KEEPALIVE
-    void setBodyVelocity(int index, double vx, double vy) {
-        if (index >= 0 && index < bodies.size()) {
-            bodies[index].vx = vx;
-            bodies[index].vy = vy;
-            // vz remains unchanged (0 for 2D view)
-        }
+    double getPeriodicOrbitPeriod() {
+        return periodicOrbitPeriod;
     }
     
     EMSCRIPTEN_KEEPALIVE
-    void setBodyMass(int index, double mass) {
-        if (index >= 0 && index < bodies.size()) {
-            bodies[index].mass = mass;
-            // Update radius based on mass (radius ~ mass^(1/3) for constant density)
-            bodies[index].radius = 5.0 + pow(mass / 10.0, 0.4) * 5.0;
-        }
+    double getPeriodicOrbitResidual() {
+        return periodicOrbitResidual;
     }
     
     EMSCRIPTEN_KEEPALIVE
-    void setBodyColor(int index, unsigned int color) {
-        if (index >= 0 && index < bodies.size()) {
-            bodies[index].color = color;
-        }
+    void setPeriodicTolerance(double tolerance) {
+        periodicTolerance = std::max(tolerance, 1e-15);
     }
     
     EMSCRIPTEN_KEEPALIVE
-    int findBodyAtPosition(double x, double y) {
-        for (int i = bodies.size() - 1; i >= 0; i--) {
-            double dx = bodies[i].x - x;
-            double dy = bodies[i].y - y;
-            // Use 2D projection (ignore z for clicking)
-            double dist = sqrt(dx * dx + dy * dy);
-            if (dist <= bodies[i].radius * 1.5) {  // 1.5x for easier clicking
-                return i;
-            }
+    void setVariationalSteps(int steps) {
+        variationalSteps = std::max(steps, 1);
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    int getVariationalSteps() {
+        return variationalSteps;
+    }
+    
+    // State transition matrix of the current bodies over duration: 6N × 6N
+    // row-major, rows/columns ordered x0 y0 z0 x1 ... then vx0 vy0 vz0 ...
+    // The bodies are not advanced. Valid until the next periodic-orbit call.
+    EMSCRIPTEN_KEEPALIVE
+    double* computeMonodromy(double duration) {
+        const size_t n = bodies.size();
+        if (n == 0) return nullptr;
+        variational.resize(n);
+        shooting.start.resize(6 * n);
+        for (size_t i = 0; i < n; i++) {
+            const Body& b = bodyAt(i);
+            shooting.start[3 * i] = b.x;
+            shooting.start[3 * i + 1] = b.y;
+            shooting.start[3 * i + 2] = b.z;
+            shooting.start[3 * n + 3 * i] = b.vx;
+            shooting.start[3 * n + 3 * i + 1] = b.vy;
+            shooting.start[3 * n + 3 * i + 2] = b.vz;
+            variational.gm[i] = G * b.mass;
         }
-        return -1;
+        beginVariational(variational, shooting.start.data());
+        propagateVariational(variational, duration, variationalSteps);
+        return variational.stm.data();
     }
     
     EMSCRIPTEN_KEEPALIVE
     double getDistance(int index1, int index2) {
         if (index1 >= 0 && index1 < bodies.size() && index2 >= 0 && index2 < bodies.size()) {
-            double dx = bodies[index2].x - bodies[index1].x;
-            double dy = bodies[index2].y - bodies[index1].y;
-            double dz = bodies[index2].z - bodies[index1].z;
+            const Body& a = bodyAt(index1);
+            const Body& b = bodyAt(index2);
+            double dx = b.x - a.x;
+            double dy = b.y - a.y;
+            double dz = b.z - a.z;
             return sqrt(dx * dx + dy * dy + dz * dz);
         }
         return 0.0;
@@ -1536,17 +6475,18 @@ extern "C" {
     EMSCRIPTEN_KEEPALIVE
     double getKineticEnergy(int index) {
         if (index >= 0 && index < bodies.size()) {
-            double speedSq = bodies[index].vx * bodies[index].vx + 
-                            bodies[index].vy * bodies[index].vy + 
-                            bodies[index].vz * bodies[index].vz;
-            return 0.5 * bodies[index].mass * speedSq;
+            const Body& body = bodyAt(index);
+            double speedSq = body.vx * body.vx + 
+                            body.vy * body.vy + 
+                            body.vz * body.vz;
+            return 0.5 * body.mass * speedSq;
         }
         return 0.0;
     }
     
     EMSCRIPTEN_KEEPALIVE
     void saveState() {
-        initialBodies = bodies;
+        saveInitialBodies();
     }
     
     // New physics control functions
@@ -1563,6 +6503,7 @@ extern "C" {
     EMSCRIPTEN_KEEPALIVE
     void setTidalForces(int enabled) {
         enableTidalForces = (enabled != 0);
+        selectKernels();
     }
     
     EMSCRIPTEN_KEEPALIVE
@@ -1573,6 +6514,7 @@ extern "C" {
     EMSCRIPTEN_KEEPALIVE
     void setSofteningLength(double length) {
         softeningLength = length;
+        selectKernels();
     }
     
     EMSCRIPTEN_KEEPALIVE
@@ -1583,6 +6525,7 @@ extern "C" {
     EMSCRIPTEN_KEEPALIVE
     void setGravitationalWaves(int enabled) {
         enableGravitationalWaves = (enabled != 0);
+        selectKernels();
     }
     
     EMSCRIPTEN_KEEPALIVE
@@ -1590,8 +6533,114 @@ extern "C" {
         return enableGravitationalWaves ? 1 : 0;
     }
     
+    EMSCRIPTEN_KEEPALIVE
+    void setPostNewtonian(int enabled) {
+        enablePostNewtonian = (enabled != 0);
+        selectKernels();
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    int getPostNewtonian() {
+        return enablePostNewtonian ? 1 : 0;
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    void setDrag(double coefficient) {
+        dragCoefficient = std::max(coefficient, 0.0);
+        selectKernels();
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    double getDrag() {
+        return dragCoefficient;
+    }
+    
+    // Analytic Kepler steps whenever the system is a hierarchy (see KEPLER FAST-FORWARD)
+    EMSCRIPTEN_KEEPALIVE
+    void setKeplerFastForward(int enabled) {
+        keplerFastForward = (enabled != 0);
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    int getKeplerFastForward() {
+        return keplerFastForward ? 1 : 0;
+    }
+    
+    // Largest perturbation / primary pull a secondary may feel
+    EMSCRIPTEN_KEEPALIVE
+    void setKeplerTolerance(double tolerance) {
+        if (tolerance >= 0.0) keplerTolerance = tolerance;
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    double getKeplerTolerance() {
+        return keplerTolerance;
+    }
+    
+    // Primary of the last step if it was analytic, -1 if it was integrated
+    EMSCRIPTEN_KEEPALIVE
+    int getKeplerPrimary() {
+        return bodyRank(keplerStepPrimary);
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    void setMixedPrecision(int enabled) {
+        mixedPrecision = (enabled != 0);
+        selectKernels();
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    int getMixedPrecision() {
+        return mixedPrecision ? 1 : 0;
+    }
+    
+    // Threads stepping alongside the caller on large scenes (-1 = one per
+    // extra core, 0 = serial); always 0 in builds without threads
+    EMSCRIPTEN_KEEPALIVE
+    void setWorkerThreads(int count) {
+        requestedWorkers = count < 0 ? -1 : count;
+        stopWorkers();
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    int getWorkerThreads() {
+        return activeWorkers() - 1;
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    double getTasksStolen() {
+        return static_cast<double>(tasksStolen.load());
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    void setParticleMesh(int enabled) {
+        particleMeshEnabled = (enabled != 0);
+        selectKernels();
+        markDiagnosticsDirty();
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    int getParticleMesh() {
+        return particleMeshEnabled ? 1 : 0;
+    }
+    
+    // Grid cells per side, rounded down to a power of two in [8, 128]
+    EMSCRIPTEN_KEEPALIVE
+    void setMeshSize(int cells) {
+        int size = 8;
+        while (size * 2 <= cells && size < MAX_MESH_SIZE) size *= 2;
+        meshSize = size;
+        markDiagnosticsDirty();
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    int getMeshSize() {
+        return meshSize;
+    }
+    
     EMSCRIPTEN_KEEPALIVE
     double getAngularMomentum() {
+        ensureDiagnostics();
         // Return magnitude for backward compatibility
         return sqrt(angularMomentumX * angularMomentumX + 
                    angularMomentumY * angularMomentumY + 
@@ -1600,31 +6649,37 @@ extern "C" {
     
     EMSCRIPTEN_KEEPALIVE
     double getAngularMomentumX() {
+        ensureDiagnostics();
         return angularMomentumX;
     }
     
     EMSCRIPTEN_KEEPALIVE
     double getAngularMomentumY() {
+        ensureDiagnostics();
         return angularMomentumY;
     }
     
     EMSCRIPTEN_KEEPALIVE
     double getAngularMomentumZ() {
+        ensureDiagnostics();
         return angularMomentumZ;
     }
     
     EMSCRIPTEN_KEEPALIVE
     double getEnergyDrift() {
+        ensureDiagnostics();
         return energyDrift;
     }
     
     EMSCRIPTEN_KEEPALIVE
     double getMomentumDrift() {
+        ensureDiagnostics();
         return momentumDrift;
     }
     
     EMSCRIPTEN_KEEPALIVE
     double getAngularMomentumDrift() {
+        ensureDiagnostics();
         return angularMomentumDrift;
     }
     
@@ -1669,8 +6724,9 @@ extern "C" {
             0xFFFFFFFF,  // White spacecraft
             0.0, 0.0
         });
-        spacecraftBodyIndex = bodies.size() - 1;
+        spacecraftBody = bodyHandle(bodies.size() - 1);
         deltaVUsed = deltaV;
+        markDiagnosticsDirty();
         
         // Start mission
         missionState = MISSION_RUNNING;
@@ -1679,17 +6735,40 @@ extern "C" {
     
     EMSCRIPTEN_KEEPALIVE
     double getThreatDistance() {
-        if (gameMode != GAME_MODE_ACTIVE || earthBodyIndex < 0 || asteroidBodyIndex < 0 ||
-            earthBodyIndex >= bodies.size() || asteroidBodyIndex >= bodies.size()) {
+        const int earth = bodyHandleSlot(earthBody);
+        const int asteroid = bodyHandleSlot(asteroidBody);
+        if (gameMode != GAME_MODE_ACTIVE || earth < 0 || asteroid < 0) {
             return -1.0;
         }
         
-        double dx = bodies[asteroidBodyIndex].x - bodies[earthBodyIndex].x;
-        double dy = bodies[asteroidBodyIndex].y - bodies[earthBodyIndex].y;
-        double dz = bodies[asteroidBodyIndex].z - bodies[earthBodyIndex].z;
+        double dx = bodies[asteroid].x - bodies[earth].x;
+        double dy = bodies[asteroid].y - bodies[earth].y;
+        double dz = bodies[asteroid].z - bodies[earth].z;
         return sqrt(dx * dx + dy * dy + dz * dz);
     }
     
+    /**
+     * Look-ahead: closest approach of bodies a and b within the next horizon
+     * of simulated time, solved on their conic when one is the primary of
+     * a Kepler hierarchy and the other a secondary (e.g. Earth and the
+     * asteroid before deploySpacecraft). Returns -1 when the pair is not on
+     * an analytic orbit.
+     */
+    EMSCRIPTEN_KEEPALIVE
+    double predictClosestApproach(int a, int b, double horizon) {
+        const int n = static_cast<int>(bodies.size());
+        if (a < 0 || b < 0 || a >= n || b >= n || a == b || horizon < 0.0) return -1.0;
+        a = static_cast<int>(bodySlot(a));
+        b = static_cast<int>(bodySlot(b));
+        int p = findKeplerPrimary();
+        if (p != a && p != b) return -1.0;
+        const Body& primary = bodies[p];
+        const Body& other = bodies[p == a ? b : a];
+        const double r0[3] = { other.x - primary.x, other.y - primary.y, other.z - primary.z };
+        const double v0[3] = { other.vx - primary.vx, other.vy - primary.vy, other.vz - primary.vz };
+        return keplerClosestApproach(G * (primary.mass + other.mass), r0, v0, horizon);
+    }
+    
     EMSCRIPTEN_KEEPALIVE
     double getMissionTime() {
         return missionTime;
@@ -1732,22 +6811,403 @@ extern "C" {
     
     EMSCRIPTEN_KEEPALIVE
     int getEarthIndex() {
-        return earthBodyIndex;
+        return bodyRank(bodyHandleSlot(earthBody));
     }
     
     EMSCRIPTEN_KEEPALIVE
     int getAsteroidIndex() {
-        return asteroidBodyIndex;
+        return bodyRank(bodyHandleSlot(asteroidBody));
     }
     
     EMSCRIPTEN_KEEPALIVE
     int getSpacecraftIndex() {
-        return spacecraftBodyIndex;
+        return bodyRank(bodyHandleSlot(spacecraftBody));
+    }
+    
+    // Rolling drift statistics (since the last reset/preset)
+    EMSCRIPTEN_KEEPALIVE
+    void setDriftSampleInterval(int steps) {
+        driftSampleInterval = steps > 0 ? steps : 0;
+        stepsSinceDriftSample = 0;
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    int getDriftSampleInterval() {
+        return driftSampleInterval;
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    double getEnergyDriftMax() {
+        return energyDriftStats.max;
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    double getEnergyDriftRMS() {
+        return driftRMS(energyDriftStats);
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    double getEnergyDriftTimeOfMax() {
+        return energyDriftStats.timeOfMax;
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    double getMomentumDriftMax() {
+        return momentumDriftStats.max;
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    double getMomentumDriftRMS() {
+        return driftRMS(momentumDriftStats);
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    double getMomentumDriftTimeOfMax() {
+        return momentumDriftStats.timeOfMax;
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    double getAngularMomentumDriftMax() {
+        return angularMomentumDriftStats.max;
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    double getAngularMomentumDriftRMS() {
+        return driftRMS(angularMomentumDriftStats);
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    double getAngularMomentumDriftTimeOfMax() {
+        return angularMomentumDriftStats.timeOfMax;
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    int getDriftSampleCount() {
+        return energyDriftStats.samples;
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    double getSimulationTime() {
+        return simulationTime;
+    }
+    
+    // Render state export (see RenderHeaderField); returns the frame address.
+    // withDiagnostics also refreshes the energy/momentum header fields.
+    EMSCRIPTEN_KEEPALIVE
+    double* getRenderState(int withDiagnostics) {
+        return buildRenderState(withDiagnostics != 0, false);
+    }
+    
+    /**
+     * Same frame, but positions/velocities are Hermite-interpolated alpha of
+     * the way through the last advanceFrame() step (the simulation time field
+     * matches). Shows the current state after any edit or load.
+     */
+    EMSCRIPTEN_KEEPALIVE
+    double* getInterpolatedRenderState(int withDiagnostics) {
+        return buildRenderState(withDiagnostics != 0, true);
+    }
+    
+    /**
+     * Advance by elapsedSeconds of wall-clock time in whole dt steps; returns
+     * the number of steps taken. When more than maxStepsPerFrame are due the
+     * backlog is dropped instead of growing without bound.
+     */
+    EMSCRIPTEN_KEEPALIVE
+    int advanceFrame(double elapsedSeconds) {
+        if (elapsedSeconds <= 0.0 || bodies.empty()) return 0;
+        frameAccumulator += elapsedSeconds * stepRate * timeScale;
+        
+        int steps = static_cast<int>(frameAccumulator);
+        if (steps > maxStepsPerFrame) {
+            droppedSteps += steps - maxStepsPerFrame;
+            steps = maxStepsPerFrame;
+        }
+        frameAccumulator -= static_cast<int>(frameAccumulator);
+        if (steps == 0) return 0;
+        
+        // Fixed step: speed comes from the step count, not the step size
+        double savedTimeScale = timeScale;
+        timeScale = 1.0;
+        for (int i = 0; i < steps; i++) {
+            if (i == steps - 1) {
+                previousBodies = bodies;
+            }
+            updateBodies();
+        }
+        timeScale = savedTimeScale;
+        lastFrameStep = dt;
+        interpolationVersion = stateVersion;
+        return steps;
+    }
+    
+    // Fraction of a step accumulated but not yet simulated (0..1)
+    EMSCRIPTEN_KEEPALIVE
+    double getInterpolationAlpha() {
+        return frameAccumulator;
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    void setStepRate(double stepsPerSecond) {
+        if (stepsPerSecond > 0.0) stepRate = stepsPerSecond;
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    double getStepRate() {
+        return stepRate;
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    void setMaxStepsPerFrame(int steps) {
+        if (steps > 0) maxStepsPerFrame = steps;
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    double getDroppedSteps() {
+        return static_cast<double>(droppedSteps);
+    }
+    
+    // Forget pending time (e.g. after a pause, so resuming does not jump)
+    EMSCRIPTEN_KEEPALIVE
+    void resetFrameClock() {
+        frameAccumulator = 0.0;
+    }
+    
+    /**
+     * Advance the scaled simulation by duration. While the system is a
+     * Kepler hierarchy this takes analytic jumps as long as
+     * keplerJumpLimit() allows (one step for an isolated pair); otherwise,
+     * and once the hierarchy breaks, whole dt * timeScale integrator steps.
+     * Returns the number of steps taken (none while dt * timeScale is not
+     * positive, e.g. paused with timeScale 0).
+     */
+    EMSCRIPTEN_KEEPALIVE
+    int fastForward(double duration) {
+        const double step = dt * timeScale;
+        if (duration <= 0.0 || step <= 0.0 || bodies.empty()) return 0;
+        double savedDt = dt;
+        double savedTimeScale = timeScale;
+        timeScale = 1.0;
+        
+        double remaining = duration;
+        int steps = 0;
+        while (remaining > 1e-12 * step) {
+            dt = std::min(remaining, std::max(step, keplerJumpLimit()));
+            updateBodies();
+            remaining -= dt;
+            steps++;
+        }
+        
+        dt = savedDt;
+        timeScale = savedTimeScale;
+        return steps;
+    }
+    
+    /**
+     * Event registration (see EVENTS). direction: +1 rising, -1 falling,
+     * 0 both; e.g. -1 on a distance event fires when the bodies come within
+     * the threshold. Each returns the event id used in the records.
+     */
+    EMSCRIPTEN_KEEPALIVE
+    int addDistanceEvent(int bodyA, int bodyB, double threshold, int direction) {
+        eventDefinitions.push_back({ EVENT_DISTANCE, bodyReferenceSlot(bodyA), bodyReferenceSlot(bodyB), 0,
+                                     threshold, direction, true, true });
+        return static_cast<int>(eventDefinitions.size()) - 1;
+    }
+    
+    // Every local minimum of the separation between two bodies
+    EMSCRIPTEN_KEEPALIVE
+    int addApproachEvent(int bodyA, int bodyB) {
+        eventDefinitions.push_back({ EVENT_APPROACH, bodyReferenceSlot(bodyA), bodyReferenceSlot(bodyB), 0,
+                                     0.0, 1, true, true });
+        return static_cast<int>(eventDefinitions.size()) - 1;
+    }
+    
+    // Body A crossing the plane coordinate[axis] = offset, measured relative
+    // to reference (or absolute when reference < 0): Poincaré sections
+    EMSCRIPTEN_KEEPALIVE
+    int addPlaneEvent(int body, int reference, int axis, double offset, int direction) {
+        if (axis < 0 || axis > 2) return -1;
+        body = bodyReferenceSlot(body);
+        reference = bodyReferenceSlot(reference);
+        eventDefinitions.push_back({ EVENT_PLANE, body, reference, axis, offset, direction, true, true });
+        return static_cast<int>(eventDefinitions.size()) - 1;
+    }
+    
+    // Ids stay valid: removed events are only deactivated
+    EMSCRIPTEN_KEEPALIVE
+    void removeEvent(int id) {
+        if (id >= 0 && id < static_cast<int>(eventDefinitions.size())) {
+            eventDefinitions[id].active = false;
+        }
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    void clearEvents() {
+        // Poincaré sections lose their trigger events with the rest
+        for (auto& sampler : phaseSamplers) {
+            if (sampler.eventId >= 0) sampler.active = false;
+        }
+        eventDefinitions.clear();
+        eventLogStart = 0;
+        eventLogCount = 0;
+        eventsDropped = 0;
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    int getPendingEventCount() {
+        return eventLogCount;
+    }
+    
+    // Move up to maxEvents oldest records into out (maxEvents × stride doubles)
+    EMSCRIPTEN_KEEPALIVE
+    int drainEvents(double* out, int maxEvents) {
+        int count = out ? std::min(maxEvents, eventLogCount) : 0;
+        for (int i = 0; i < count; i++) {
+            const double* record = &eventLog[eventLogStart * EVENT_RECORD_STRIDE];
+            std::copy(record, record + EVENT_RECORD_STRIDE, out + i * EVENT_RECORD_STRIDE);
+            eventLogStart = (eventLogStart + 1) % EVENT_LOG_CAPACITY;
+            eventLogCount--;
+        }
+        return count;
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    int getEventRecordStride() {
+        return EVENT_RECORD_STRIDE;
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    double getEventsDropped() {
+        return static_cast<double>(eventsDropped);
+    }
+    
+    /**
+     * Poincaré section: (coordU, coordV) of body, relative to reference,
+     * at each crossing of coordinate[axis] = offset in the given direction
+     * (see addPlaneEvent). Returns the sampler id.
+     */
+    EMSCRIPTEN_KEEPALIVE
+    int addPoincareSection(int body, int reference, int axis, double offset, int direction,
+                           int coordU, int coordV, int capacity) {
+        if (axis < 0 || axis > 2 || coordU < 0 || coordU >= PHASE_COORDINATE_COUNT ||
+            coordV < 0 || coordV >= PHASE_COORDINATE_COUNT || capacity <= 0) {
+            return -1;
+        }
+        body = bodyReferenceSlot(body);
+        reference = bodyReferenceSlot(reference);
+        eventDefinitions.push_back({ EVENT_PLANE, body, reference, axis, offset, direction, true, false });
+        int eventId = static_cast<int>(eventDefinitions.size()) - 1;
+        phaseSamplers.push_back({ body, reference, coordU, coordV, eventId, 0, 0, 0, 0, capacity, true,
+                                  std::vector<double>(2 * static_cast<size_t>(capacity), 0.0) });
+        return static_cast<int>(phaseSamplers.size()) - 1;
+    }
+    
+    // Phase-space trajectory: (coordU, coordV) every interval steps
+    EMSCRIPTEN_KEEPALIVE
+    int addPhaseSampler(int body, int reference, int coordU, int coordV, int interval, int capacity) {
+        if (coordU < 0 || coordU >= PHASE_COORDINATE_COUNT || coordV < 0 ||
+            coordV >= PHASE_COORDINATE_COUNT || capacity <= 0) {
+            return -1;
+        }
+        body = bodyReferenceSlot(body);
+        reference = bodyReferenceSlot(reference);
+        phaseSamplers.push_back({ body, reference, coordU, coordV, -1, std::max(interval, 1), 0, 0, 0,
+                                  capacity, true, std::vector<double>(2 * static_cast<size_t>(capacity), 0.0) });
+        return static_cast<int>(phaseSamplers.size()) - 1;
+    }
+    
+    /**
+     * Sampler ring buffer: capacity (u, v) pairs; the oldest of the count
+     * valid pairs is at (head - count + capacity) % capacity. Re-create the
+     * JS view after memory growth.
+     */
+    EMSCRIPTEN_KEEPALIVE
+    double* getSamplerBuffer(int id) {
+        if (id < 0 || id >= static_cast<int>(phaseSamplers.size())) return nullptr;
+        return phaseSamplers[id].points.data();
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    int getSamplerCapacity(int id) {
+        if (id < 0 || id >= static_cast<int>(phaseSamplers.size())) return 0;
+        return phaseSamplers[id].capacity;
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    int getSamplerCount(int id) {
+        if (id < 0 || id >= static_cast<int>(phaseSamplers.size())) return 0;
+        return phaseSamplers[id].count;
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    int getSamplerHead(int id) {
+        if (id < 0 || id >= static_cast<int>(phaseSamplers.size())) return 0;
+        return phaseSamplers[id].head;
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    void clearSamplerPoints(int id) {
+        if (id >= 0 && id < static_cast<int>(phaseSamplers.size())) {
+            phaseSamplers[id].head = 0;
+            phaseSamplers[id].count = 0;
+        }
+    }
+    
+    // Ids stay valid: removed samplers (and their section events) are deactivated
+    EMSCRIPTEN_KEEPALIVE
+    void removeSampler(int id) {
+        if (id < 0 || id >= static_cast<int>(phaseSamplers.size())) return;
+        PhaseSampler& sampler = phaseSamplers[id];
+        sampler.active = false;
+        if (sampler.eventId >= 0 && sampler.eventId < static_cast<int>(eventDefinitions.size())) {
+            eventDefinitions[sampler.eventId].active = false;
+        }
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    int getRenderStateSize() {
+        return static_cast<int>(renderState.size());
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    int getRenderHeaderSize() {
+        return RENDER_HEADER_SIZE;
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    int getRenderBodyStride() {
+        return RENDER_BODY_STRIDE;
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    int getRenderParticleStride() {
+        return RENDER_PARTICLE_STRIDE;
+    }
+    
+    // Profiling: fills perfStatsSnapshot and returns its address.
+    // View from JS as new Float64Array(HEAPF64.buffer, ptr, getPerfStatsSize())
+    // (layout: see struct PerfStats)
+    EMSCRIPTEN_KEEPALIVE
+    double* getPerfStats() {
+        perfStatsSnapshot = perfStats;
+        return reinterpret_cast<double*>(&perfStatsSnapshot);
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    int getPerfStatsSize() {
+        return sizeof(PerfStats) / sizeof(double);
+    }
+    
+    EMSCRIPTEN_KEEPALIVE
+    void resetPerfStats() {
+        perfStats = PerfStats();
     }
     
     EMSCRIPTEN_KEEPALIVE
     void saveInitialState() {
         // Save initial conservation values for drift monitoring (3D)
+        ensureDiagnostics();
         initialEnergy = totalEnergy;
         initialMomentumX = totalMomentumX;
         initialMomentumY = totalMomentumY;
@@ -1758,11 +7218,16 @@ extern "C" {
         energyDrift = 0.0;
         momentumDrift = 0.0;
         angularMomentumDrift = 0.0;
+        simulationTime = 0.0;
+        resetDriftStats();
     }
 }
 
+// Native harnesses include this file and provide their own main()
+#ifndef THREEBODY_NO_MAIN
 int main() {
     printf("Three-body simulation starting...\n");
     init();
     return 0;
 }
+#endif